@@ -0,0 +1,133 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Benchmark of compute_screen_layout, independent of python.
+// Usage : bench [solver (graph|isl)] [max screens (default 6)] [repeat (default 3)]
+// Outputs one JSON object per line on stdout, for each (screen count, resolutions, constraints) case.
+
+#include "screen_layout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <sys/resource.h>
+
+using namespace screen_layout;
+
+namespace {
+	// Screen resolution mixes, sizes taken cyclically
+	struct resolution_mix {
+		const char * name;
+		pair sizes[3];
+	};
+	const resolution_mix resolution_mixes[] = {
+		{"1080p", {pair (1920, 1080), pair (1920, 1080), pair (1920, 1080)}},
+		{"mixed", {pair (1920, 1080), pair (2560, 1440), pair (3840, 2160)}},
+		{"mixed_rotated", {pair (2560, 1440), pair (1080, 1920), pair (3840, 2160)}}
+	};
+
+	enum constraint_density { density_none, density_chain, density_full };
+	const char * density_names[] = {"none", "chain", "full"};
+
+	setting mk_constraints (int nb_screen, constraint_density density) {
+		// chain : each screen left of or above the next one, alternating ; full : every pair ordered left to right
+		setting constraints = mk_setting (nb_screen);
+		for (int i = 0; i < nb_screen; ++i)
+			for (int j = i + 1; j < nb_screen; ++j) {
+				dir d = none;
+				if (density == density_full) d = left;
+				if (density == density_chain && j == i + 1) d = i % 2 == 0 ? left : above;
+				constraints[i][j] = d;
+				constraints[j][i] = dir (dir_invert (d));
+			}
+		return constraints;
+	}
+
+	long peak_memory_kb (void) {
+		struct rusage usage;
+		getrusage (RUSAGE_SELF, &usage);
+		return usage.ru_maxrss;
+	}
+}
+
+int main (int argc, char ** argv) {
+	// Exact search only, so that results stay comparable when defaults of the heuristics change
+	search_options options;
+	options.heuristic_min_screen = 0;
+	options.decompose = false;
+	options.enumeration = lexicographic_order;
+	options.time_budget = 0;
+	const char * solver_name = "graph";
+	if (argc > 1) {
+		solver_name = argv[1];
+		if (std::strcmp (solver_name, "graph") == 0) {
+			options.solver = constraint_graph;
+		} else if (std::strcmp (solver_name, "isl") == 0) {
+			options.solver = isl_lexmin;
+		} else {
+			std::fprintf (stderr, "unknown solver '%s' (graph or isl)\n", solver_name);
+			return EXIT_FAILURE;
+		}
+	}
+	int max_screen = argc > 2 ? std::atoi (argv[2]) : 6;
+	int repeat = argc > 3 ? std::max (1, std::atoi (argv[3])) : 3;
+
+	typedef std::chrono::steady_clock clock;
+	for (int nb_screen = 1; nb_screen <= max_screen; ++nb_screen) {
+		for (const resolution_mix & mix : resolution_mixes) {
+			for (int density = density_none; density <= density_full; ++density) {
+				pair_list screen_sizes;
+				for (int i = 0; i < nb_screen; ++i) screen_sizes.push_back (mix.sizes[i % 3]);
+				setting constraints = mk_constraints (nb_screen, constraint_density (density));
+				pair vscreen_min (0, 0);
+				pair vscreen_max (16384, 16384);
+
+				double total_ns = 0;
+				double min_ns = std::numeric_limits< double >::max ();
+				search_stats stats;
+				bool found = false;
+				for (int r = 0; r < repeat; ++r) {
+					pair vscreen_size;
+					pair_list screen_positions;
+					clock::time_point start = clock::now ();
+					found = compute_screen_layout (vscreen_min, vscreen_max, screen_sizes, constraints, vscreen_size, screen_positions, options, stats);
+					double ns = std::chrono::duration_cast< std::chrono::nanoseconds > (clock::now () - start).count ();
+					total_ns += ns;
+					min_ns = std::min (min_ns, ns);
+				}
+				double mean_ns = total_ns / repeat;
+
+				std::printf ("{\"solver\": \"%s\", \"nb_screen\": %d, \"resolutions\": \"%s\", \"constraints\": \"%s\", "
+						"\"found\": %s, \"repeat\": %d, \"mean_ns\": %.0f, \"min_ns\": %.0f, \"nb_template\": %ld, \"nb_packer\": %ld, "
+						"\"templates_per_second\": %.0f, \"peak_memory_kb\": %ld}\n",
+						solver_name, nb_screen, mix.name, density_names[density],
+						found ? "true" : "false", repeat, mean_ns, min_ns, stats.nb_template, stats.nb_packer,
+						stats.nb_template / (mean_ns * 1e-9), peak_memory_kb ());
+				std::fflush (stdout);
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -20,12 +20,37 @@
 // WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "screen_layout.h"
+#include "layout_cache.h"
+#include "layout_future.h"
+#include "layout_store.h"
+#include "randr_query.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 
 #include <boost/python.hpp>
 namespace py = boost::python;
 
 /* ------------------------- screen layout ------------------ */
 namespace screen_layout {
+	class gil_release {
+		/* Let other python threads run during a native computation (no python object must be used meanwhile).
+		 */
+		public:
+			gil_release (void) : state (PyEval_SaveThread ()) {}
+			~gil_release (void) { PyEval_RestoreThread (state); }
+
+		private:
+			PyThreadState * state;
+
+			gil_release (const gil_release &);
+			gil_release & operator= (const gil_release &);
+	};
+
 	static pair mk_pair (py::object iterable) { return pair (py::extract< int > (iterable[0]), py::extract< int > (iterable[1])); }
 	static py::tuple mk_py_tuple (const pair & p) { return py::make_tuple (p.x, p.y); }
 
@@ -33,39 +58,449 @@ namespace screen_layout {
 		"Computes the optimal screen layout coordinates\n"
 		"Input {\n"
 		"   (w, h) : virtual screen maximum size\n"
-		"   [(w0, h0), ...] : screen sizes\n"
-		"   [[c00, c01, ...], [c10, ...], ...] : relation between screens as a matrix\n"
+		"   [(w0, h0), ...] : screen sizes (or buffer of int32 pairs, like a Nx2 array)\n"
+		"   [[c00, c01, ...], [c10, ...], ...] : relation between screens as a matrix (or buffer of NxN int8)\n"
+		"   options : SearchOptions (optional)\n"
+		"   cache : LayoutCache used to reuse results (optional)\n"
+		"   positions : writable buffer of N int32 pairs receiving screen coordinates (optional)\n"
+		"   stats : SearchStats filled with search counters and timers (optional)\n"
+		"   (input buffers are read without python objects, but copied ; only positions is written in place)\n"
 		"}\n"
 		"Output {\n"
 		"   (w, h) : virtual screen size\n"
-		"   [(x0, y0), ...] : sequence of coordinates for screens\n"
+		"   [(x0, y0), ...] : sequence of coordinates for screens (or the positions buffer if given)\n"
+		"   complete : False if stopped by the time budget (the layout is the best found so far)\n"
+		"   heuristic : True if found by a partial search (annealing, insertion, decomposition), it may not be optimal\n"
+		"}\n";
+
+	const char * py_insertion_doc =
+		"Computes the screen layout after one screen was added to a known layout\n"
+		"Other screens keep their relative order (from previous positions), only the insertion of the new one is searched\n"
+		"Falls back to a full search if no insertion fits constraints and limits\n"
+		"Input {\n"
+		"   vscreen_min_size, vscreen_max_size, screen_sizes, constraints : as screen_layout\n"
+		"   new_screen : index of the added screen\n"
+		"   [(x0, y0), ...] : previous positions of the other screens, in order\n"
+		"   options : SearchOptions (optional)\n"
+		"   stats : SearchStats (optional)\n"
+		"}\n"
+		"Output : as screen_layout\n";
+
+	const char * py_ranking_doc =
+		"Computes the best distinct screen layouts in one search, to propose alternatives\n"
+		"Input {\n"
+		"   vscreen_min_size, vscreen_max_size, screen_sizes, constraints : as screen_layout\n"
+		"   nb_solution : maximum number of layouts returned\n"
+		"   options : SearchOptions (optional)\n"
+		"   stats : SearchStats (optional)\n"
+		"}\n"
+		"Output {\n"
+		"   [result, ...] : screen_layout results, best first (empty if infeasible)\n"
 		"}\n";
 
-	static py::object py_func (py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints) {
-		int nb_screen = py::len (py_screen_sizes);
-		pair screen_max_size = mk_pair (py_screen_max_size);
-		pair screen_min_size = mk_pair (py_screen_min_size);
-		
-		pair_list screen_sizes;
-		for (int i = 0; i < nb_screen; ++i) screen_sizes.push_back (mk_pair (py_screen_sizes[i]));
-		
-		setting constraints = mk_setting (nb_screen);
-		for (int i = 0; i < py::len (py_constraints) && i < nb_screen; ++i) {
-			py::object t = py_constraints[i];
-			for (int j = 0; j < py::len (t) && j < nb_screen; ++j)
-				constraints[i][j] = py::extract< dir > (t[j]);
+	const char * py_adjacency_doc =
+		"Relations between screens whose borders touch, as the constraints of screen_layout\n"
+		"Input {\n"
+		"   [(x0, y0), ...] : screen positions (or buffer of int32 pairs)\n"
+		"   [(w0, h0), ...] : screen sizes (or buffer of int32 pairs)\n"
+		"}\n"
+		"Output {\n"
+		"   bytes of NxN int8 : direction of screen i relative to screen j at i * N + j (left if i is left of j)\n"
+		"}\n";
+
+	const char * py_batch_doc =
+		"Computes screen layouts for a list of independent problems, in parallel\n"
+		"Input {\n"
+		"   [(vscreen_min_size, vscreen_max_size, screen_sizes, constraints), ...] : problems, as screen_layout arguments\n"
+		"   options : SearchOptions (optional, nb_thread is the number of problems solved at once)\n"
+		"   cache : LayoutCache used to reuse results (optional)\n"
+		"}\n"
+		"Output {\n"
+		"   [result, ...] : screen_layout result for each problem (None if infeasible)\n"
+		"}\n";
+
+	const char * py_async_doc =
+		"Starts a screen_layout computation in a background thread\n"
+		"Same arguments as screen_layout (the cache is kept alive by the future)\n"
+		"Returns a LayoutFuture\n";
+
+	const char * py_future_doc =
+		"Running screen_layout computation\n"
+		"fileno () : descriptor that becomes readable when the result is ready (do not read from it)\n"
+		"ready () : True if the result is ready\n"
+		"result () : wait for and return the screen_layout result, or raise its error\n"
+		"Deleting an unfinished future cancels its computation (other searches using the cancellation token of options are not cancelled)\n";
+
+	const char * py_options_doc =
+		"Search parameters for screen_layout\n"
+		"   nb_thread : number of worker threads (0 = one per hardware thread)\n"
+		"   solver : SolverBackend used to pack templates (constraint_graph by default, or isl_lexmin)\n"
+		"   time_budget : search deadline in milliseconds (0 = no limit, negative = first layout only), only honoured once a layout is found\n"
+		"   heuristic_min_screen : use simulated annealing from this screen count (0 = never, default)\n"
+		"   heuristic_iterations : number of annealing moves\n"
+		"   seed : annealing random seed (results are deterministic for a given seed)\n"
+		"   decompose : pack groups of screens unrelated by constraints separately (faster, may not be optimal ; False by default)\n"
+		"   enumeration : EnumerationOrder of templates (lexicographic_order by default, or minimal_change_order)\n"
+		"   cancellation : CancellationToken stopping the search (None by default)\n";
+
+	const char * py_cancellation_doc =
+		"Stops the searches using it (set in SearchOptions.cancellation) ; a cancelled search returns None\n"
+		"cancel () / reset () : set or clear the cancellation request (usable from another thread)\n"
+		"watch (fd) : also cancelled while fd has data to read, like an event queue (-1 = none, data is not read)\n"
+		"cancelled : True if searches would stop now\n";
+
+	const char * py_stats_doc =
+		"Counters and timers of a screen_layout search\n"
+		"   complete : False if stopped by the time budget or cancelled\n"
+		"   cached : result taken from the cache (other fields are zero)\n"
+		"   heuristic : layout found by a partial search, annealing, insertion or decomposition (template counters are about evaluated candidates)\n"
+		"   cancelled : stopped by the cancellation token of options (no layout returned)\n"
+		"   nb_template : templates enumerated (compatible with constraints)\n"
+		"   nb_template_constraint_rejected : sequence pairs excluded by constraints\n"
+		"   nb_template_bound_rejected : templates that cannot fit in the virtual screen\n"
+		"   nb_template_pruned : templates not packed (bounded out, or time budget)\n"
+		"   nb_packer, nb_infeasible, nb_improving : packers built, without solution, improving the best one\n"
+		"   enumeration_ns, packer_build_ns, packer_solve_ns, total_ns : durations (packer ones summed over threads)\n";
+
+	const char * py_cache_doc =
+		"Cache of screen_layout results, keyed by problem and by the SearchOptions fields that change results\n"
+		"LayoutCache () : in memory only\n"
+		"LayoutCache (filename) : entries are appended to the file, and loaded from it at construction (files of another version are discarded)\n"
+		"precompute (..., options) : same arguments as screen_layout, queue it for computation by a background idle thread\n"
+		"   (without the time budget and cancellation of options ; the running one is cancelled when the cache is deleted)\n";
+
+	const char * py_randr_doc =
+		"RandR state queries on a dedicated xcb connection, with all requests of a query pipelined\n"
+		"RandrQuery (display, root) : connects to display ('' for the default one) ; root is the root window of the screen\n"
+		"query () : RandrState of the screen, or None if the configuration changed during the query\n"
+		"nb_round_trip () : round trips of the last query (1 if crtc and output lists did not change)\n"
+		"RandrState fields are the ones of xcb replies :\n"
+		"   timestamp, config_timestamp, width, height (root window), modes, crtcs and outputs (ids)\n"
+		"   crtc_info and output_info : RandrCrtc and RandrOutput in the order of crtcs and outputs\n"
+		"   RandrOutput.edid is the raw EDID property as bytes (empty if missing or invalid)\n";
+
+	const char * py_store_doc =
+		"Persistent memory mapped map from edid sets to bytes (serialized layouts)\n"
+		"LayoutStore (filename) : opens the file or creates it, without reading its records\n"
+		"get (edids) : bytes stored for the set of edids, or None\n"
+		"put (edids, value) : stores bytes for the set of edids (replaced if present)\n"
+		"get_metadata (name), put_metadata (name, value) : same for named records, not part of layouts\n"
+		"append_journal (name, value, restart) : appends bytes to a named journal ; restart drops previous entries\n"
+		"read_journal (name) : list of journal entries since the last restart, oldest first\n"
+		"keys () : list of edid frozensets\n";
+
+	class py_buffer {
+		/* Contiguous view of an object supporting the buffer protocol (numpy arrays, array.array, memoryview).
+		 * Used to read inputs and write outputs without per element python objects.
+		 * Inputs are still copied into the native problem (sizes by element, constraints as one block) ; only outputs are written in place.
+		 */
+		public:
+			py_buffer (py::object obj, int flags) {
+				if (PyObject_GetBuffer (obj.ptr (), &view, flags | PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+					py::throw_error_already_set ();
+			}
+			~py_buffer (void) { PyBuffer_Release (&view); }
+
+			static bool supported (py::object obj) { return PyObject_CheckBuffer (obj.ptr ()); }
+
+			// Checks native element format (one of codes) and item size, returns the number of elements
+			Py_ssize_t elements (const char * codes, Py_ssize_t itemsize, const char * what) const {
+				const char * format = view.format != 0 ? view.format : "B";
+				if (*format == '@' || *format == '=') ++format;
+				if (view.itemsize != itemsize || format[0] == '\0' || format[1] != '\0' || std::strchr (codes, format[0]) == 0)
+					throw std::runtime_error (std::string ("screen_layout: invalid buffer format for ") + what);
+				return view.len / itemsize;
+			}
+
+			template< typename T > T * data (void) const { return static_cast< T * > (view.buf); }
+
+		private:
+			Py_buffer view;
+
+			py_buffer (const py_buffer &);
+			py_buffer & operator= (const py_buffer &);
+	};
+
+	// Sequence of pairs, or buffer of 2N int32 (like a Nx2 array)
+	static pair_list mk_pair_list (py::object py_pairs, const char * what) {
+		pair_list pairs;
+		if (py_buffer::supported (py_pairs)) {
+			py_buffer buffer (py_pairs, PyBUF_SIMPLE);
+			const std::int32_t * values = buffer.data< const std::int32_t > ();
+			Py_ssize_t nb_values = buffer.elements ("il", sizeof (std::int32_t), what);
+			if (nb_values % 2 != 0)
+				throw std::runtime_error (std::string ("screen_layout: ") + what + " buffer must contain pairs");
+			for (Py_ssize_t i = 0; i < nb_values / 2; ++i) pairs.push_back (pair (values[2 * i], values[2 * i + 1]));
+		} else {
+			for (int i = 0; i < py::len (py_pairs); ++i) pairs.push_back (mk_pair (py_pairs[i]));
 		}
+		return pairs;
+	}
+
+	static layout_problem mk_problem (py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints) {
+		layout_problem problem;
+		problem.vscreen_max_size = mk_pair (py_screen_max_size);
+		problem.vscreen_min_size = mk_pair (py_screen_min_size);
+
+		problem.screen_sizes = mk_pair_list (py_screen_sizes, "screen sizes");
+		int nb_screen = problem.screen_sizes.size ();
 
-		pair_list screen_positions;
-		pair screen_size;
-		if (not compute_screen_layout (screen_min_size, screen_max_size, screen_sizes, constraints, screen_size, screen_positions))
+		// Constraints : matrix as nested sequences (can be partial), or buffer of NxN int8
+		problem.user_constraints = mk_setting (nb_screen);
+		if (py_buffer::supported (py_constraints)) {
+			py_buffer constraints (py_constraints, PyBUF_SIMPLE);
+			const std::int8_t * values = constraints.data< const std::int8_t > ();
+			if (constraints.elements ("bB", sizeof (std::int8_t), "constraints") != nb_screen * nb_screen)
+				throw std::runtime_error ("screen_layout: constraints buffer must be a screen x screen matrix");
+			for (int k = 0; k < nb_screen * nb_screen; ++k)
+				if (values[k] < none || values[k] > under)
+					throw std::runtime_error ("screen_layout: invalid direction in constraints buffer");
+			// Same row major int8 layout : copy as is
+			std::memcpy (problem.user_constraints.data (), values, nb_screen * nb_screen);
+		} else {
+			for (int i = 0; i < py::len (py_constraints) && i < nb_screen; ++i) {
+				py::object t = py_constraints[i];
+				for (int j = 0; j < py::len (t) && j < nb_screen; ++j)
+					problem.user_constraints[i][j] = py::extract< dir > (t[j]);
+			}
+		}
+		return problem;
+	}
+
+	static layout_cache * mk_cache (py::object py_cache) {
+		if (py_cache.is_none ()) return 0;
+		return &py::extract< layout_cache & > (py_cache) ();
+	}
+
+	static py::object mk_py_result (const layout_result & result) {
+		if (not result.found)
 			return py::object (); // None
 
 		py::list py_screen_pos;
-		for (int i = 0; i < nb_screen; ++i)
-			py_screen_pos.append (mk_py_tuple (screen_positions[i]));
+		for (unsigned i = 0; i < result.screen_positions.size (); ++i)
+			py_screen_pos.append (mk_py_tuple (result.screen_positions[i]));
+
+		return py::make_tuple (mk_py_tuple (result.vscreen_size), py_screen_pos, result.complete, result.heuristic);
+	}
+
+	static std::string py_stats_str (const search_stats & stats) {
+		std::ostringstream os;
+		if (stats.cached) {
+			os << "cached";
+		} else {
+			os << (stats.heuristic ? "heuristic, " : "") << (stats.cancelled ? "cancelled" : stats.complete ? "complete" : "incomplete") << ", templates " << stats.nb_template
+				<< " (constraint rejected " << stats.nb_template_constraint_rejected << ", bound rejected " << stats.nb_template_bound_rejected
+				<< ", pruned " << stats.nb_template_pruned << "), packers " << stats.nb_packer
+				<< " (infeasible " << stats.nb_infeasible << ", improving " << stats.nb_improving
+				<< "), time " << stats.total_ns / 1000 << "us (enumeration " << stats.enumeration_ns / 1000
+				<< "us, packer build " << stats.packer_build_ns / 1000 << "us, packer solve " << stats.packer_solve_ns / 1000 << "us)";
+		}
+		return os.str ();
+	}
+
+	static std::shared_ptr< cancellation_token > py_options_get_cancellation (const search_options & options) { return options.cancellation; }
+	static void py_options_set_cancellation (search_options & options, std::shared_ptr< cancellation_token > token) { options.cancellation = token; }
+
+	static py::object py_func (py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints, const search_options & options, py::object py_cache, py::object py_positions, py::object py_stats) {
+		layout_problem problem = mk_problem (py_screen_min_size, py_screen_max_size, py_screen_sizes, py_constraints);
+		layout_cache * cache = mk_cache (py_cache);
+		search_stats local_stats;
+		search_stats & stats = py_stats.is_none () ? local_stats : py::extract< search_stats & > (py_stats) ();
+
+		// Check output buffer before the computation
+		std::unique_ptr< py_buffer > positions;
+		if (not py_positions.is_none ()) {
+			positions.reset (new py_buffer (py_positions, PyBUF_WRITABLE));
+			if (positions->elements ("il", sizeof (std::int32_t), "positions") != 2 * static_cast< Py_ssize_t > (problem.screen_sizes.size ()))
+				throw std::runtime_error ("screen_layout: positions buffer must contain one pair per screen");
+		}
+
+		layout_result result;
+		{
+			gil_release unlocked;
+			if (cache == 0)
+				compute_screen_layout (problem, result, options, stats);
+			else
+				compute_screen_layout (*cache, problem, result, options, stats);
+		}
+
+		if (positions and result.found) {
+			std::int32_t * values = positions->data< std::int32_t > ();
+			for (unsigned i = 0; i < result.screen_positions.size (); ++i) {
+				values[2 * i] = result.screen_positions[i].x;
+				values[2 * i + 1] = result.screen_positions[i].y;
+			}
+			return py::make_tuple (mk_py_tuple (result.vscreen_size), py_positions, result.complete, result.heuristic);
+		}
+		return mk_py_result (result);
+	}
+
+	static py::object py_insertion_func (py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints, int new_screen, py::object py_previous_positions, const search_options & options, py::object py_stats) {
+		layout_problem problem = mk_problem (py_screen_min_size, py_screen_max_size, py_screen_sizes, py_constraints);
+		pair_list previous_positions;
+		for (int i = 0; i < py::len (py_previous_positions); ++i) previous_positions.push_back (mk_pair (py_previous_positions[i]));
+		search_stats local_stats;
+		search_stats & stats = py_stats.is_none () ? local_stats : py::extract< search_stats & > (py_stats) ();
+
+		layout_result result;
+		{
+			gil_release unlocked;
+			compute_screen_layout_insertion (problem, new_screen, previous_positions, result, options, stats);
+		}
+		return mk_py_result (result);
+	}
+
+	static py::list py_ranking_func (py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints, int nb_solution, const search_options & options, py::object py_stats) {
+		layout_problem problem = mk_problem (py_screen_min_size, py_screen_max_size, py_screen_sizes, py_constraints);
+		search_stats local_stats;
+		search_stats & stats = py_stats.is_none () ? local_stats : py::extract< search_stats & > (py_stats) ();
+
+		std::vector< layout_result > results;
+		{
+			gil_release unlocked;
+			compute_screen_layout_ranking (problem, nb_solution, results, options, stats);
+		}
+
+		py::list py_results;
+		for (unsigned i = 0; i < results.size (); ++i)
+			py_results.append (mk_py_result (results[i]));
+		return py_results;
+	}
+
+	static layout_future * py_async_func (py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints, const search_options & options, py::object py_cache) {
+		layout_problem problem = mk_problem (py_screen_min_size, py_screen_max_size, py_screen_sizes, py_constraints);
+		return new layout_future (problem, options, mk_cache (py_cache));
+	}
 
-		return py::make_tuple (mk_py_tuple (screen_size), py_screen_pos);
+	static py::object py_future_result (layout_future & future) {
+		const layout_result * result;
+		{
+			gil_release unlocked;
+			result = &future.get ();
+		}
+		return mk_py_result (*result);
+	}
+
+	static py::list py_batch_func (py::object py_problems, const search_options & options, py::object py_cache) {
+		std::vector< layout_problem > problems;
+		for (int i = 0; i < py::len (py_problems); ++i) {
+			py::object p = py_problems[i];
+			problems.push_back (mk_problem (p[0], p[1], p[2], p[3]));
+		}
+
+		layout_cache * cache = mk_cache (py_cache);
+		std::vector< layout_result > results;
+		{
+			gil_release unlocked;
+			if (cache == 0)
+				compute_screen_layouts (problems, results, options);
+			else
+				compute_screen_layouts (*cache, problems, results, options);
+		}
+
+		py::list py_results;
+		for (unsigned i = 0; i < results.size (); ++i)
+			py_results.append (mk_py_result (results[i]));
+		return py_results;
+	}
+
+	static layout_store::edid_set mk_edid_set (py::object py_edids) {
+		py::list edid_list (py_edids); // Any iterable, like a frozenset
+		layout_store::edid_set edids;
+		for (int i = 0; i < py::len (edid_list); ++i) edids.push_back (py::extract< std::string > (edid_list[i]));
+		return edids;
+	}
+
+	static std::string mk_bytes (py::object py_value) {
+		if (not PyBytes_Check (py_value.ptr ()))
+			throw std::runtime_error ("layout_store: value must be bytes");
+		return std::string (PyBytes_AS_STRING (py_value.ptr ()), PyBytes_GET_SIZE (py_value.ptr ()));
+	}
+
+	static py::object mk_py_bytes (bool found, const std::string & value) {
+		if (not found) return py::object (); // None
+		return py::object (py::handle<> (PyBytes_FromStringAndSize (value.data (), value.size ())));
+	}
+
+	static py::object py_store_get (const layout_store & store, py::object py_edids) {
+		std::string value;
+		bool found = store.get (mk_edid_set (py_edids), value);
+		return mk_py_bytes (found, value);
+	}
+	static void py_store_put (layout_store & store, py::object py_edids, py::object py_value) {
+		store.put (mk_edid_set (py_edids), mk_bytes (py_value));
+	}
+	static py::object py_store_get_metadata (const layout_store & store, const std::string & name) {
+		std::string value;
+		bool found = store.get_metadata (name, value);
+		return mk_py_bytes (found, value);
+	}
+	static void py_store_put_metadata (layout_store & store, const std::string & name, py::object py_value) {
+		store.put_metadata (name, mk_bytes (py_value));
+	}
+	static void py_store_append_journal (layout_store & store, const std::string & name, py::object py_value, bool restart) {
+		store.append_journal (name, mk_bytes (py_value), restart);
+	}
+	static py::list py_store_read_journal (const layout_store & store, const std::string & name) {
+		std::vector< std::string > entries = store.read_journal (name);
+		py::list py_entries;
+		for (unsigned i = 0; i < entries.size (); ++i) py_entries.append (mk_py_bytes (true, entries[i]));
+		return py_entries;
+	}
+	template< typename T > static py::list mk_py_list (const std::vector< T > & values) {
+		py::list py_values;
+		for (unsigned i = 0; i < values.size (); ++i) py_values.append (values[i]);
+		return py_values;
+	}
+	template< typename S, typename T, std::vector< T > S::* member > static py::list py_list_member (const S & s) { return mk_py_list (s.*member); }
+
+	static int py_crtc_num_outputs (const randr_crtc & crtc) { return crtc.outputs.size (); }
+	static std::string py_output_name (const randr_output & output) { return output.name; }
+	static py::object py_output_edid (const randr_output & output) { return mk_py_bytes (true, output.edid); }
+
+	// Id lists, like the xcb screen resources reply
+	static py::list py_state_crtcs (const randr_state & state) {
+		py::list ids;
+		for (unsigned c = 0; c < state.crtcs.size (); ++c) ids.append (state.crtcs[c].id);
+		return ids;
+	}
+	static py::list py_state_outputs (const randr_state & state) {
+		py::list ids;
+		for (unsigned o = 0; o < state.outputs.size (); ++o) ids.append (state.outputs[o].id);
+		return ids;
+	}
+
+	static py::object py_randr_query (randr_query & query) {
+		randr_state state;
+		bool valid;
+		{
+			gil_release unlocked;
+			valid = query.query (state);
+		}
+		if (not valid) return py::object (); // None
+		return py::object (state);
+	}
+
+	static py::list py_store_keys (const layout_store & store) {
+		std::vector< layout_store::edid_set > keys = store.keys ();
+		py::list py_keys;
+		for (unsigned i = 0; i < keys.size (); ++i) {
+			py::list edids;
+			for (unsigned e = 0; e < keys[i].size (); ++e) edids.append (keys[i][e]);
+			py_keys.append (py::object (py::handle<> (PyFrozenSet_New (edids.ptr ()))));
+		}
+		return py_keys;
+	}
+
+	static py::object py_adjacency_func (py::object py_positions, py::object py_sizes) {
+		setting relations;
+		screen_adjacency (mk_pair_list (py_positions, "positions"), mk_pair_list (py_sizes, "sizes"), relations);
+		const char * data = reinterpret_cast< const char * > (relations.data ());
+		return py::object (py::handle<> (PyBytes_FromStringAndSize (data, relations.size () * relations.size ())));
+	}
+
+	static void py_precompute (layout_cache & cache, py::object py_screen_min_size, py::object py_screen_max_size, py::object py_screen_sizes, py::object py_constraints, const search_options & options) {
+		cache.precompute (mk_problem (py_screen_min_size, py_screen_max_size, py_screen_sizes, py_constraints), options);
 	}
 }
 
@@ -77,5 +512,146 @@ BOOST_PYTHON_MODULE (ext) {
 	def ("Dir_invert", screen_layout::dir_invert);
 	def ("Dir_str", screen_layout::dir_str);
 
-	def ("screen_layout", screen_layout::py_func, screen_layout::py_doc);
+	enum_< screen_layout::solver_backend > ("SolverBackend")
+		.value ("isl_lexmin", screen_layout::isl_lexmin)
+		.value ("constraint_graph", screen_layout::constraint_graph);
+
+	enum_< screen_layout::enumeration_order > ("EnumerationOrder")
+		.value ("lexicographic_order", screen_layout::lexicographic_order)
+		.value ("minimal_change_order", screen_layout::minimal_change_order);
+
+	class_< screen_layout::search_options > ("SearchOptions", screen_layout::py_options_doc)
+		.def_readwrite ("nb_thread", &screen_layout::search_options::nb_thread)
+		.def_readwrite ("solver", &screen_layout::search_options::solver)
+		.def_readwrite ("time_budget", &screen_layout::search_options::time_budget)
+		.def_readwrite ("heuristic_min_screen", &screen_layout::search_options::heuristic_min_screen)
+		.def_readwrite ("heuristic_iterations", &screen_layout::search_options::heuristic_iterations)
+		.def_readwrite ("seed", &screen_layout::search_options::seed)
+		.def_readwrite ("decompose", &screen_layout::search_options::decompose)
+		.def_readwrite ("enumeration", &screen_layout::search_options::enumeration)
+		.add_property ("cancellation", screen_layout::py_options_get_cancellation, screen_layout::py_options_set_cancellation);
+
+	class_< screen_layout::cancellation_token, std::shared_ptr< screen_layout::cancellation_token >, boost::noncopyable > ("CancellationToken", screen_layout::py_cancellation_doc, init<> ())
+		.def ("cancel", &screen_layout::cancellation_token::cancel)
+		.def ("reset", &screen_layout::cancellation_token::reset)
+		.def ("watch", &screen_layout::cancellation_token::watch, arg ("fd"))
+		.add_property ("cancelled", &screen_layout::cancellation_token::cancelled);
+
+	class_< screen_layout::search_stats > ("SearchStats", screen_layout::py_stats_doc)
+		.def_readonly ("complete", &screen_layout::search_stats::complete)
+		.def_readonly ("cached", &screen_layout::search_stats::cached)
+		.def_readonly ("heuristic", &screen_layout::search_stats::heuristic)
+		.def_readonly ("cancelled", &screen_layout::search_stats::cancelled)
+		.def_readonly ("nb_template", &screen_layout::search_stats::nb_template)
+		.def_readonly ("nb_template_constraint_rejected", &screen_layout::search_stats::nb_template_constraint_rejected)
+		.def_readonly ("nb_template_bound_rejected", &screen_layout::search_stats::nb_template_bound_rejected)
+		.def_readonly ("nb_template_pruned", &screen_layout::search_stats::nb_template_pruned)
+		.def_readonly ("nb_packer", &screen_layout::search_stats::nb_packer)
+		.def_readonly ("nb_infeasible", &screen_layout::search_stats::nb_infeasible)
+		.def_readonly ("nb_improving", &screen_layout::search_stats::nb_improving)
+		.def_readonly ("enumeration_ns", &screen_layout::search_stats::enumeration_ns)
+		.def_readonly ("packer_build_ns", &screen_layout::search_stats::packer_build_ns)
+		.def_readonly ("packer_solve_ns", &screen_layout::search_stats::packer_solve_ns)
+		.def_readonly ("total_ns", &screen_layout::search_stats::total_ns)
+		.def ("__str__", screen_layout::py_stats_str);
+
+	class_< screen_layout::layout_cache, boost::noncopyable > ("LayoutCache", screen_layout::py_cache_doc, init<> ())
+		.def (init< std::string > ())
+		.def ("__len__", &screen_layout::layout_cache::size)
+		.def ("clear", &screen_layout::layout_cache::clear)
+		.def ("precompute", screen_layout::py_precompute,
+				(arg ("self"), arg ("vscreen_min_size"), arg ("vscreen_max_size"), arg ("screen_sizes"), arg ("constraints"), arg ("options") = screen_layout::search_options ()))
+		.def ("nb_pending", &screen_layout::layout_cache::nb_pending);
+
+	class_< screen_layout::layout_store, boost::noncopyable > ("LayoutStore", screen_layout::py_store_doc, init< std::string > ())
+		.def ("__len__", &screen_layout::layout_store::size)
+		.def ("get", screen_layout::py_store_get)
+		.def ("put", screen_layout::py_store_put)
+		.def ("get_metadata", screen_layout::py_store_get_metadata)
+		.def ("put_metadata", screen_layout::py_store_put_metadata)
+		.def ("append_journal", screen_layout::py_store_append_journal)
+		.def ("read_journal", screen_layout::py_store_read_journal)
+		.def ("keys", screen_layout::py_store_keys);
+
+	class_< screen_layout::randr_mode > ("RandrMode", no_init)
+		.def_readonly ("id", &screen_layout::randr_mode::id)
+		.def_readonly ("width", &screen_layout::randr_mode::width)
+		.def_readonly ("height", &screen_layout::randr_mode::height)
+		.def_readonly ("dot_clock", &screen_layout::randr_mode::dot_clock)
+		.def_readonly ("htotal", &screen_layout::randr_mode::htotal)
+		.def_readonly ("vtotal", &screen_layout::randr_mode::vtotal);
+
+	class_< screen_layout::randr_crtc > ("RandrCrtc", no_init)
+		.def_readonly ("id", &screen_layout::randr_crtc::id)
+		.def_readonly ("x", &screen_layout::randr_crtc::x)
+		.def_readonly ("y", &screen_layout::randr_crtc::y)
+		.def_readonly ("width", &screen_layout::randr_crtc::width)
+		.def_readonly ("height", &screen_layout::randr_crtc::height)
+		.def_readonly ("mode", &screen_layout::randr_crtc::mode)
+		.def_readonly ("rotation", &screen_layout::randr_crtc::rotation)
+		.def_readonly ("rotations", &screen_layout::randr_crtc::rotations)
+		.add_property ("num_outputs", screen_layout::py_crtc_num_outputs)
+		.add_property ("outputs", screen_layout::py_list_member< screen_layout::randr_crtc, std::uint32_t, &screen_layout::randr_crtc::outputs >)
+		.add_property ("possible", screen_layout::py_list_member< screen_layout::randr_crtc, std::uint32_t, &screen_layout::randr_crtc::possible >);
+
+	class_< screen_layout::randr_output > ("RandrOutput", no_init)
+		.def_readonly ("id", &screen_layout::randr_output::id)
+		.add_property ("name", screen_layout::py_output_name)
+		.def_readonly ("connection", &screen_layout::randr_output::connection)
+		.def_readonly ("crtc", &screen_layout::randr_output::crtc)
+		.def_readonly ("mm_width", &screen_layout::randr_output::mm_width)
+		.def_readonly ("mm_height", &screen_layout::randr_output::mm_height)
+		.def_readonly ("num_preferred", &screen_layout::randr_output::num_preferred)
+		.add_property ("crtcs", screen_layout::py_list_member< screen_layout::randr_output, std::uint32_t, &screen_layout::randr_output::crtcs >)
+		.add_property ("modes", screen_layout::py_list_member< screen_layout::randr_output, std::uint32_t, &screen_layout::randr_output::modes >)
+		.add_property ("clones", screen_layout::py_list_member< screen_layout::randr_output, std::uint32_t, &screen_layout::randr_output::clones >)
+		.add_property ("edid", screen_layout::py_output_edid);
+
+	class_< screen_layout::randr_state > ("RandrState", no_init)
+		.def_readonly ("timestamp", &screen_layout::randr_state::timestamp)
+		.def_readonly ("config_timestamp", &screen_layout::randr_state::config_timestamp)
+		.def_readonly ("width", &screen_layout::randr_state::width)
+		.def_readonly ("height", &screen_layout::randr_state::height)
+		.add_property ("modes", screen_layout::py_list_member< screen_layout::randr_state, screen_layout::randr_mode, &screen_layout::randr_state::modes >)
+		.add_property ("crtcs", screen_layout::py_state_crtcs)
+		.add_property ("outputs", screen_layout::py_state_outputs)
+		.add_property ("crtc_info", screen_layout::py_list_member< screen_layout::randr_state, screen_layout::randr_crtc, &screen_layout::randr_state::crtcs >)
+		.add_property ("output_info", screen_layout::py_list_member< screen_layout::randr_state, screen_layout::randr_output, &screen_layout::randr_state::outputs >);
+
+	class_< screen_layout::randr_query, boost::noncopyable > ("RandrQuery", screen_layout::py_randr_doc, init< std::string, std::uint32_t > ())
+		.def ("query", screen_layout::py_randr_query)
+		.def ("nb_round_trip", &screen_layout::randr_query::nb_round_trip);
+
+	def ("screen_layout", screen_layout::py_func,
+			(arg ("vscreen_min_size"), arg ("vscreen_max_size"), arg ("screen_sizes"), arg ("constraints"),
+			 arg ("options") = screen_layout::search_options (), arg ("cache") = object (), arg ("positions") = object (), arg ("stats") = object ()),
+			screen_layout::py_doc);
+
+	class_< screen_layout::layout_future, boost::noncopyable > ("LayoutFuture", screen_layout::py_future_doc, no_init)
+		.def ("fileno", &screen_layout::layout_future::fileno)
+		.def ("ready", &screen_layout::layout_future::ready)
+		.def ("result", screen_layout::py_future_result);
+
+	// Future keeps the cache alive
+	def ("screen_layout_async", screen_layout::py_async_func,
+			(arg ("vscreen_min_size"), arg ("vscreen_max_size"), arg ("screen_sizes"), arg ("constraints"),
+			 arg ("options") = screen_layout::search_options (), arg ("cache") = object ()),
+			return_value_policy< manage_new_object, with_custodian_and_ward_postcall< 0, 6 > > (),
+			screen_layout::py_async_doc);
+
+	def ("screen_layout_insertion", screen_layout::py_insertion_func,
+			(arg ("vscreen_min_size"), arg ("vscreen_max_size"), arg ("screen_sizes"), arg ("constraints"), arg ("new_screen"), arg ("previous_positions"),
+			 arg ("options") = screen_layout::search_options (), arg ("stats") = object ()),
+			screen_layout::py_insertion_doc);
+
+	def ("screen_layout_ranking", screen_layout::py_ranking_func,
+			(arg ("vscreen_min_size"), arg ("vscreen_max_size"), arg ("screen_sizes"), arg ("constraints"), arg ("nb_solution"),
+			 arg ("options") = screen_layout::search_options (), arg ("stats") = object ()),
+			screen_layout::py_ranking_doc);
+
+	def ("screen_adjacency", screen_layout::py_adjacency_func, (arg ("positions"), arg ("sizes")), screen_layout::py_adjacency_doc);
+
+	def ("screen_layouts", screen_layout::py_batch_func,
+			(arg ("problems"), arg ("options") = screen_layout::search_options (), arg ("cache") = object ()),
+			screen_layout::py_batch_doc);
 }
@@ -0,0 +1,120 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Self checks of the layout engine internals.
+// Usage : check (prints one line per check, exit status is the failure count, 0 if all passed)
+
+// Internals are static : the engine is compiled in this translation unit
+#include "screen_layout.cpp"
+
+#include <cstdio>
+#include <random>
+
+using namespace screen_layout;
+
+namespace {
+	int nb_failure = 0;
+
+	void check (bool condition, const char * section, const char * what, int case_index) {
+		if (condition) return;
+		std::printf ("FAIL %s : %s (case %d)\n", section, what, case_index);
+		nb_failure++;
+	}
+
+	void set_constraint (setting & constraints, int sa, int sb, dir d) {
+		constraints[sa][sb] = d;
+		constraints[sb][sa] = dir_invert (d);
+	}
+
+	// Each screen after the first one is related to a random previous one
+	setting random_tree (int nb_screen, std::mt19937 & random) {
+		setting constraints = mk_setting (nb_screen);
+		for (int s = 1; s < nb_screen; ++s) set_constraint (constraints, s, random () % s, dir (left + random () % 4));
+		return constraints;
+	}
+
+	// Template relations as one integer, 2 bits per pair
+	template< typename Template > unsigned long long template_key (const Template & t, int nb_screen) {
+		unsigned long long key = 0;
+		for (int sa = 0; sa < nb_screen; ++sa)
+			for (int sb = 0; sb < sa; ++sb) key = (key << 2) | (t.ordering (sa, sb) - 1);
+		return key;
+	}
+
+	// Random relations between a fraction of the pairs (may be contradictory : no template at all)
+	setting random_constraints (int nb_screen, int percent, std::mt19937 & random) {
+		setting constraints = mk_setting (nb_screen);
+		for (int sa = 0; sa < nb_screen; ++sa)
+			for (int sb = 0; sb < sa; ++sb)
+				if (int (random () % 100) < percent) set_constraint (constraints, sa, sb, dir (left + random () % 4));
+		return constraints;
+	}
+
+	void check_minimal_change_order (void) {
+		/*
+		 * Incremental template updates must match a full recomputation at every step, even when incompatible
+		 * permutations are skipped (several transpositions in one step).
+		 * The enumeration must give the same templates as the lexicographic one, and change one pair per step without constraints.
+		 */
+		const char * section = "minimal_change_order";
+		std::mt19937 random (7);
+		int nb_case = 0;
+		long nb_step = 0;
+		for (int nb_screen = 1; nb_screen <= 6; ++nb_screen)
+			for (int k = 0; k < 12; ++k, ++nb_case) {
+				int percent = k == 0 ? 0 : nb_screen <= 4 ? 10 * k : 30 + 6 * k;
+				setting constraints = random_constraints (nb_screen, percent, random);
+				if (k == 11) constraints = random_tree (nb_screen, random);
+
+				std::vector< unsigned long long > lexicographic, minimal_change;
+				sequence_pair seq_pair (nb_screen, constraints);
+				for (bool more = seq_pair.first (); more; more = seq_pair.next ())
+					lexicographic.push_back (template_key (seq_pair.relations (), nb_screen));
+
+				minimal_change_sequence_pair mc_pair (nb_screen, constraints);
+				layout_template t;
+				bool consistent = true, single_change = true;
+				for (bool more = mc_pair.first (); more; more = mc_pair.next (), ++nb_step) {
+					if (minimal_change.empty ()) {
+						t = mc_pair.relations ();
+					} else {
+						mc_pair.update_relations (t);
+						consistent = consistent && template_key (t, nb_screen) == template_key (mc_pair.relations (), nb_screen);
+						single_change = single_change && mc_pair.changed_pairs ().size () == 1;
+					}
+					minimal_change.push_back (template_key (t, nb_screen));
+				}
+				check (consistent, section, "updated relations equal recomputed relations at each step", nb_case);
+				if (k == 0) check (single_change, section, "one pair changes per step without constraints", nb_case);
+
+				std::sort (lexicographic.begin (), lexicographic.end ());
+				std::sort (minimal_change.begin (), minimal_change.end ());
+				check (lexicographic == minimal_change, section, "same templates as the lexicographic enumeration", nb_case);
+			}
+		std::printf ("%s : %d cases, %ld steps\n", section, nb_case, nb_step);
+	}
+}
+
+int main (void) {
+	check_minimal_change_order ();
+	std::printf ("%s : %d failure(s)\n", nb_failure == 0 ? "OK" : "FAILED", nb_failure);
+	return nb_failure;
+}
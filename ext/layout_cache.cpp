@@ -0,0 +1,261 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "layout_cache.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace screen_layout {
+
+	/* File format : native endian int32 values
+	 * - header : magic, version
+	 * - records : key length (in values), key values, found, vscreen size, nb positions, positions
+	 *
+	 * Key is the problem serialized as int32 values : vscreen min/max, nb screen, screen sizes, constraints, then options.
+	 * Only the lower triangle of constraints is used by compute_screen_layout, so only it is part of the key.
+	 * Options are those changing results : not the thread count, time budget or cancellation (incomplete results are not kept).
+	 *
+	 * Bump file_version whenever default search behavior or the search algorithm changes results (same key, other layout).
+	 */
+	static const std::int32_t file_magic = 0x534c4d43; // "SLMC"
+	static const std::int32_t file_version = 3;
+
+	typedef std::vector< std::int32_t > value_vector;
+
+	static std::string make_key (const layout_problem & problem, const search_options & options) {
+		int nb_screen = problem.screen_sizes.size ();
+		value_vector v;
+		v.push_back (problem.vscreen_min_size.x); v.push_back (problem.vscreen_min_size.y);
+		v.push_back (problem.vscreen_max_size.x); v.push_back (problem.vscreen_max_size.y);
+		v.push_back (nb_screen);
+		for (int sc = 0; sc < nb_screen; ++sc) {
+			v.push_back (problem.screen_sizes[sc].x); v.push_back (problem.screen_sizes[sc].y);
+		}
+		for (int sa = 0; sa < nb_screen; ++sa)
+			for (int sb = 0; sb < sa; ++sb)
+				v.push_back (problem.user_constraints[sa][sb]);
+		v.push_back (options.solver);
+		v.push_back (options.heuristic_min_screen); v.push_back (options.heuristic_iterations); v.push_back (std::int32_t (options.seed));
+		v.push_back (options.decompose);
+		v.push_back (options.enumeration);
+		return std::string (reinterpret_cast< const char * > (v.data ()), v.size () * sizeof (std::int32_t));
+	}
+
+	layout_cache::layout_cache (const std::string & _filename) :
+		filename (_filename), precompute_cancellation (std::make_shared< cancellation_token > ()), stopping (false)
+	{
+		load ();
+	}
+
+	layout_cache::~layout_cache (void) {
+		{
+			std::lock_guard< std::mutex > guard (lock);
+			stopping = true;
+		}
+		precompute_cancellation->cancel (); // Current job result is not wanted anymore
+		wakeup.notify_all ();
+		if (worker.joinable ()) worker.join ();
+	}
+
+	bool layout_cache::lookup (const layout_problem & problem, const search_options & options, layout_result & result) const {
+		std::string key = make_key (problem, options);
+		std::lock_guard< std::mutex > guard (lock);
+		entry_map::const_iterator it = entries.find (key);
+		if (it == entries.end ()) return false;
+		result = it->second;
+		return true;
+	}
+
+	void layout_cache::insert (const layout_problem & problem, const search_options & options, const layout_result & result) {
+		std::string key = make_key (problem, options);
+		std::lock_guard< std::mutex > guard (lock);
+		if (entries.insert (std::make_pair (key, result)).second && not filename.empty ())
+			append (key, result);
+	}
+
+	std::size_t layout_cache::size (void) const {
+		std::lock_guard< std::mutex > guard (lock);
+		return entries.size ();
+	}
+
+	void layout_cache::clear (void) {
+		std::lock_guard< std::mutex > guard (lock);
+		entries.clear ();
+	}
+
+	void layout_cache::precompute (const layout_problem & problem, const search_options & options) {
+		std::string key = make_key (problem, options);
+		std::lock_guard< std::mutex > guard (lock);
+		if (entries.count (key) > 0) return;
+		job j = { problem, options };
+		j.options.nb_thread = 1; // Only speculative work
+		j.options.time_budget = 0;
+		j.options.cancellation = precompute_cancellation;
+		jobs.push_back (j);
+		if (not worker.joinable ())
+			worker = std::thread (&layout_cache::precompute_loop, this);
+		wakeup.notify_one ();
+	}
+
+	std::size_t layout_cache::nb_pending (void) const {
+		std::lock_guard< std::mutex > guard (lock);
+		return jobs.size ();
+	}
+
+	void layout_cache::precompute_loop (void) {
+#ifdef SCHED_IDLE
+		// Only use cpu time nobody else wants
+		sched_param param;
+		param.sched_priority = 0;
+		pthread_setschedparam (pthread_self (), SCHED_IDLE, &param);
+#endif
+		std::unique_lock< std::mutex > guard (lock);
+		while (true) {
+			while (not stopping && jobs.empty ())
+				wakeup.wait (guard);
+			if (stopping) return;
+
+			job j = jobs.front ();
+			jobs.pop_front ();
+			guard.unlock ();
+			try {
+				layout_result result;
+				if (not lookup (j.problem, j.options, result)) {
+					search_stats stats;
+					compute_screen_layout (j.problem, result, j.options, stats);
+					if (result.complete and not result.heuristic and not stats.cancelled) insert (j.problem, j.options, result);
+				}
+			} catch (...) {
+				// Invalid problem : nothing to precompute, foreground computation will report it
+			}
+			guard.lock ();
+		}
+	}
+
+	void layout_cache::load (void) {
+		std::FILE * f = std::fopen (filename.c_str (), "rb");
+		if (f == 0) return; // Created on first insert
+
+		std::int32_t header[2];
+		std::size_t header_read = std::fread (header, sizeof (std::int32_t), 2, f);
+		if (header_read == 0) { std::fclose (f); return; } // Empty file
+		if (header_read != 2 || header[0] != file_magic) {
+			std::fclose (f);
+			throw std::runtime_error ("layout_cache: invalid file format");
+		}
+		if (header[1] != file_version) {
+			// Results of another search version : start again with an empty file
+			std::fclose (f);
+			if (::truncate (filename.c_str (), 0) != 0)
+				throw std::runtime_error ("layout_cache: unable to discard file of another version");
+			return;
+		}
+
+		// Read records until end of file, dropping a truncated last record (interrupted append)
+		long valid_end = std::ftell (f);
+		while (true) {
+			std::int32_t key_size;
+			if (std::fread (&key_size, sizeof (std::int32_t), 1, f) != 1 || key_size < 0) break;
+			std::string key (key_size * sizeof (std::int32_t), '\0');
+			if (std::fread (&key[0], sizeof (std::int32_t), key_size, f) != std::size_t (key_size)) break;
+
+			std::int32_t data[4]; // found, vscreen size, nb positions
+			if (std::fread (data, sizeof (std::int32_t), 4, f) != 4 || data[3] < 0) break;
+			value_vector positions (2 * data[3]);
+			if (std::fread (positions.data (), sizeof (std::int32_t), positions.size (), f) != positions.size ()) break;
+
+			layout_result result;
+			result.found = data[0] != 0;
+			result.vscreen_size = pair (data[1], data[2]);
+			for (int sc = 0; sc < data[3]; ++sc)
+				result.screen_positions.push_back (pair (positions[2 * sc], positions[2 * sc + 1]));
+			entries[key] = result;
+			valid_end = std::ftell (f);
+		}
+		std::fseek (f, 0, SEEK_END);
+		bool truncated = std::ftell (f) != valid_end;
+		std::fclose (f);
+		if (truncated && ::truncate (filename.c_str (), valid_end) != 0)
+			throw std::runtime_error ("layout_cache: unable to repair truncated file");
+	}
+
+	void layout_cache::append (const std::string & key, const layout_result & result) {
+		std::FILE * f = std::fopen (filename.c_str (), "ab");
+		if (f == 0) return; // Cache is still valid in memory
+
+		value_vector v;
+		std::fseek (f, 0, SEEK_END);
+		if (std::ftell (f) == 0) {
+			v.push_back (file_magic); v.push_back (file_version);
+		}
+		v.push_back (key.size () / sizeof (std::int32_t));
+		value_vector key_values (key.size () / sizeof (std::int32_t));
+		std::memcpy (key_values.data (), key.data (), key.size ());
+		v.insert (v.end (), key_values.begin (), key_values.end ());
+		v.push_back (result.found);
+		v.push_back (result.vscreen_size.x); v.push_back (result.vscreen_size.y);
+		v.push_back (result.screen_positions.size ());
+		for (unsigned sc = 0; sc < result.screen_positions.size (); ++sc) {
+			v.push_back (result.screen_positions[sc].x); v.push_back (result.screen_positions[sc].y);
+		}
+		std::fwrite (v.data (), sizeof (std::int32_t), v.size (), f);
+		std::fclose (f);
+	}
+
+	bool compute_screen_layout (layout_cache & cache, const layout_problem & problem, layout_result & result, const search_options & options, search_stats & stats) {
+		if (cache.lookup (problem, options, result)) {
+			stats = search_stats ();
+			stats.cached = true;
+		} else {
+			compute_screen_layout (problem, result, options, stats);
+			if (result.complete and not result.heuristic) cache.insert (problem, options, result); // Best layout of a stopped or partial search is not worth keeping
+		}
+		return result.found;
+	}
+
+	void compute_screen_layouts (layout_cache & cache, const std::vector< layout_problem > & problems, std::vector< layout_result > & results, const search_options & options) {
+		results.assign (problems.size (), layout_result ());
+
+		// Only compute the missing ones, as a batch
+		std::vector< unsigned > missing_index;
+		std::vector< layout_problem > missing;
+		for (unsigned i = 0; i < problems.size (); ++i) {
+			if (not cache.lookup (problems[i], options, results[i])) {
+				missing_index.push_back (i);
+				missing.push_back (problems[i]);
+			}
+		}
+
+		std::vector< layout_result > missing_results;
+		compute_screen_layouts (missing, missing_results, options);
+		for (unsigned k = 0; k < missing.size (); ++k) {
+			results[missing_index[k]] = missing_results[k];
+			if (missing_results[k].complete and not missing_results[k].heuristic) cache.insert (missing[k], options, missing_results[k]);
+		}
+	}
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef H_LAYOUT_CACHE
+#define H_LAYOUT_CACHE
+
+#include "screen_layout.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace screen_layout {
+
+	class layout_cache {
+		/*
+		 * Memoization of compute_screen_layout results, keyed by problem (vscreen limits, screen sizes, constraints)
+		 * and by the search options that change results (solver, heuristics, decomposition, enumeration order).
+		 * Infeasible problems are cached too, but not results of searches stopped by the time budget, or heuristic ones.
+		 *
+		 * It can be backed by a file : entries are appended to it when inserted, and all read back when opening.
+		 * Files written by another version of the search are discarded when opening.
+		 * Methods are thread safe.
+		 *
+		 * Problems can also be queued for speculative precomputation by a background thread at idle priority.
+		 * The thread is started on the first queued problem, and stopped on destruction : its current job is cancelled.
+		 */
+		public:
+			layout_cache (void) : precompute_cancellation (std::make_shared< cancellation_token > ()), stopping (false) {}
+			explicit layout_cache (const std::string & filename); // Throws std::runtime_error if file is not a cache
+			~layout_cache (void);
+
+			bool lookup (const layout_problem & problem, const search_options & options, layout_result & result) const;
+			void insert (const layout_problem & problem, const search_options & options, const layout_result & result);
+
+			std::size_t size (void) const;
+			void clear (void); // Memory only, the file is kept
+
+			// Ignored if already cached ; computed with options, without time budget nor cancellation, on one thread
+			// Cancellation of options is replaced by the one of the cache
+			void precompute (const layout_problem & problem, const search_options & options = search_options ());
+			std::size_t nb_pending (void) const;
+
+		private:
+			typedef std::map< std::string, layout_result > entry_map;
+
+			mutable std::mutex lock;
+			std::string filename;
+			entry_map entries;
+
+			void load (void);
+			void append (const std::string & key, const layout_result & result);
+
+			// Background precomputation
+			std::thread worker;
+			std::condition_variable wakeup;
+			struct job {
+				layout_problem problem;
+				search_options options;
+			};
+			std::deque< job > jobs;
+			std::shared_ptr< cancellation_token > precompute_cancellation; // Cancelled on destruction
+			bool stopping;
+
+			void precompute_loop (void);
+
+			layout_cache (const layout_cache &);
+			layout_cache & operator= (const layout_cache &);
+	};
+
+	// Cache lookup, or compute and insert
+	bool compute_screen_layout (layout_cache & cache, const layout_problem & problem, layout_result & result, const search_options & options, search_stats & stats);
+	static inline bool compute_screen_layout (layout_cache & cache, const layout_problem & problem, layout_result & result, const search_options & options = search_options ()) {
+		search_stats stats;
+		return compute_screen_layout (cache, problem, result, options, stats);
+	}
+	void compute_screen_layouts (layout_cache & cache, const std::vector< layout_problem > & problems, std::vector< layout_result > & results, const search_options & options = search_options ());
+}
+
+#endif
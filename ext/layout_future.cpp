@@ -0,0 +1,81 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "layout_future.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace screen_layout {
+
+	layout_future::layout_future (const layout_problem & _problem, const search_options & _options, layout_cache * _cache) :
+		problem (_problem), options (_options), cache (_cache)
+	{
+		options.cancellation = std::make_shared< cancellation_token > (_options.cancellation);
+		if (pipe (pipe_fd) != 0)
+			throw std::runtime_error (std::string ("layout_future: pipe: ") + std::strerror (errno));
+		fcntl (pipe_fd[0], F_SETFD, FD_CLOEXEC);
+		fcntl (pipe_fd[1], F_SETFD, FD_CLOEXEC);
+		worker = std::thread (&layout_future::run, this);
+	}
+
+	layout_future::~layout_future (void) {
+		if (worker.joinable ()) {
+			options.cancellation->cancel (); // Result is not wanted anymore
+			worker.join ();
+		}
+		close (pipe_fd[0]);
+		close (pipe_fd[1]);
+	}
+
+	bool layout_future::ready (void) const {
+		// Readable end stays readable once signaled, as the byte is never consumed
+		struct pollfd p;
+		p.fd = pipe_fd[0];
+		p.events = POLLIN;
+		return poll (&p, 1, 0) == 1;
+	}
+
+	const layout_result & layout_future::get (void) {
+		if (worker.joinable ()) worker.join ();
+		if (error) std::rethrow_exception (error);
+		return result;
+	}
+
+	void layout_future::run (void) {
+		try {
+			if (cache != 0)
+				compute_screen_layout (*cache, problem, result, options);
+			else
+				compute_screen_layout (problem, result, options);
+		} catch (...) {
+			error = std::current_exception ();
+		}
+		// Signal completion (get () joins, so it sees the result)
+		char done = 1;
+		while (write (pipe_fd[1], &done, 1) < 0 && errno == EINTR);
+	}
+}
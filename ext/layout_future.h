@@ -0,0 +1,70 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef H_LAYOUT_FUTURE
+#define H_LAYOUT_FUTURE
+
+#include "screen_layout.h"
+#include "layout_cache.h"
+
+#include <exception>
+#include <thread>
+
+namespace screen_layout {
+
+	class layout_future {
+		/*
+		 * Layout computation running in its own thread.
+		 *
+		 * fileno () is a pipe descriptor that becomes readable when the result is ready.
+		 * It can be added to a select/poll based event loop.
+		 * Destruction cancels the computation and waits for it to stop, which is short as searches check cancellation
+		 * between templates : the cache is not modified by a cancelled computation.
+		 */
+		public:
+			// Cache is optional (null), and must outlive the future
+			layout_future (const layout_problem & problem, const search_options & options, layout_cache * cache);
+			~layout_future (void);
+
+			int fileno (void) const { return pipe_fd[0]; }
+			bool ready (void) const;
+
+			// Waits for the result ; rethrows the computation error if any
+			const layout_result & get (void);
+
+		private:
+			layout_problem problem;
+			search_options options; // Cancellation is a token of the future, following the one given in options
+			layout_cache * cache;
+
+			int pipe_fd[2];
+			std::thread worker;
+			layout_result result;
+			std::exception_ptr error;
+
+			void run (void);
+
+			layout_future (const layout_future &);
+			layout_future & operator= (const layout_future &);
+	};
+}
+
+#endif
@@ -0,0 +1,382 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "layout_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace screen_layout {
+
+	static const std::uint32_t file_magic = 0x534c4d53; // "SLMS"
+	static const std::uint32_t file_version = 1;
+	static const std::uint32_t initial_nb_slot = 64;
+	static const std::uint64_t min_dead_space_rewrite = 64 * 1024;
+
+	struct layout_store::header {
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t nb_slot; // Power of 2
+		std::uint32_t nb_record; // Live records of all kinds
+		std::uint64_t nb_layout;
+		std::uint64_t end; // Used space, from file start
+		std::uint64_t dead; // Space of replaced records
+	};
+
+	struct layout_store::slot {
+		std::uint64_t hash;
+		std::uint64_t offset; // 0 if empty
+	};
+
+	struct layout_store::record {
+		std::uint32_t kind;
+		std::uint32_t key_size;
+		std::uint32_t value_size;
+		std::uint32_t reserved;
+		// Followed by key and value
+
+		const char * key (void) const { return reinterpret_cast< const char * > (this + 1); }
+		const char * value (void) const { return key () + key_size; }
+	};
+
+	std::uint64_t layout_store::record_size (std::size_t key_size, std::size_t value_size) {
+		return (sizeof (record) + key_size + value_size + 7) & ~std::uint64_t (7);
+	}
+	std::uint64_t layout_store::index_end (std::uint32_t nb_slot) {
+		return sizeof (header) + std::uint64_t (nb_slot) * sizeof (slot);
+	}
+
+	// FNV-1a 64 bits, over the kind then the key
+	static std::uint64_t key_hash (std::uint32_t kind, const std::string & key) {
+		std::uint64_t h = 14695981039346656037ull;
+		const unsigned char kind_byte = kind;
+		h = (h ^ kind_byte) * 1099511628211ull;
+		for (std::size_t i = 0; i < key.size (); ++i)
+			h = (h ^ static_cast< unsigned char > (key[i])) * 1099511628211ull;
+		return h;
+	}
+
+	// Same key for any order of the set
+	static std::string set_key (const layout_store::edid_set & edids) {
+		layout_store::edid_set sorted (edids);
+		std::sort (sorted.begin (), sorted.end ());
+		std::string key;
+		for (unsigned i = 0; i < sorted.size (); ++i) {
+			if (i > 0) key.push_back ('\0');
+			key += sorted[i];
+		}
+		return key;
+	}
+
+	static void write_fd (int fd, std::uint64_t offset, const void * data, std::size_t size) {
+		const char * p = static_cast< const char * > (data);
+		while (size > 0) {
+			ssize_t n = pwrite (fd, p, size, offset);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				throw std::runtime_error (std::string ("layout_store: write: ") + std::strerror (errno));
+			}
+			p += n; offset += n; size -= n;
+		}
+	}
+
+	layout_store::layout_store (const std::string & _filename) : filename (_filename), fd (-1), mapping (0), mapping_size (0) {
+		open_file ();
+	}
+
+	layout_store::~layout_store (void) {
+		close_file ();
+	}
+
+	bool layout_store::get (const edid_set & edids, std::string & value) const {
+		return get_record (layout_record, set_key (edids), value);
+	}
+	void layout_store::put (const edid_set & edids, const std::string & value) {
+		put_record (layout_record, set_key (edids), value);
+	}
+
+	bool layout_store::get_metadata (const std::string & name, std::string & value) const {
+		return get_record (metadata_record, name, value);
+	}
+	void layout_store::put_metadata (const std::string & name, const std::string & value) {
+		put_record (metadata_record, name, value);
+	}
+
+	std::vector< std::string > layout_store::read_journal (const std::string & name) const {
+		std::vector< std::string > entries;
+		const slot & s = slots ()[find (journal_record, name, key_hash (journal_record, name))];
+		for (std::uint64_t offset = s.offset; offset != 0;) {
+			const record * r = record_at (offset);
+			entries.push_back (std::string (r->value () + sizeof (std::uint64_t), r->value_size - sizeof (std::uint64_t)));
+			offset = previous_entry (r);
+		}
+		std::reverse (entries.begin (), entries.end ());
+		return entries;
+	}
+
+	void layout_store::append_journal (const std::string & name, const std::string & value, bool restart) {
+		const slot & s = slots ()[find (journal_record, name, key_hash (journal_record, name))];
+		std::uint64_t previous = restart ? 0 : s.offset;
+		std::string entry (reinterpret_cast< const char * > (&previous), sizeof (previous));
+		put_record (journal_record, name, entry + value, not restart);
+	}
+
+	std::size_t layout_store::size (void) const {
+		return file_header ().nb_layout;
+	}
+
+	std::vector< layout_store::edid_set > layout_store::keys (void) const {
+		std::vector< edid_set > sets;
+		for (std::uint32_t i = 0; i < file_header ().nb_slot; ++i) {
+			if (slots ()[i].offset == 0) continue;
+			const record * r = record_at (slots ()[i].offset);
+			if (r->kind != layout_record) continue;
+			edid_set edids;
+			std::string key (r->key (), r->key_size);
+			for (std::size_t start = 0; not key.empty () && start <= key.size ();) {
+				std::size_t stop = std::min (key.find ('\0', start), key.size ());
+				edids.push_back (key.substr (start, stop - start));
+				start = stop + 1;
+			}
+			sets.push_back (edids);
+		}
+		return sets;
+	}
+
+	void layout_store::open_file (void) {
+		fd = ::open (filename.c_str (), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+			throw std::runtime_error ("layout_store: unable to open '" + filename + "': " + std::strerror (errno));
+
+		struct stat st;
+		if (fstat (fd, &st) != 0) {
+			close_file ();
+			throw std::runtime_error (std::string ("layout_store: stat: ") + std::strerror (errno));
+		}
+		if (st.st_size == 0) {
+			// New file : header and empty index (zero filled)
+			header h = { file_magic, file_version, initial_nb_slot, 0, 0, index_end (initial_nb_slot), 0 };
+			if (ftruncate (fd, h.end) != 0) {
+				close_file ();
+				throw std::runtime_error (std::string ("layout_store: truncate: ") + std::strerror (errno));
+			}
+			write_fd (fd, 0, &h, sizeof (h));
+			st.st_size = h.end;
+		}
+		if (std::uint64_t (st.st_size) < sizeof (header)) {
+			close_file ();
+			throw std::runtime_error ("layout_store: invalid file format or version");
+		}
+		map_file (st.st_size);
+
+		const header & h = file_header ();
+		if (h.magic != file_magic || h.version != file_version) {
+			close_file ();
+			throw std::runtime_error ("layout_store: invalid file format or version");
+		}
+		if (h.nb_slot == 0 || (h.nb_slot & (h.nb_slot - 1)) != 0 || index_end (h.nb_slot) > h.end || h.end > mapping_size) {
+			close_file ();
+			throw std::runtime_error ("layout_store: corrupted file");
+		}
+	}
+
+	void layout_store::close_file (void) {
+		if (mapping != 0) munmap (const_cast< char * > (mapping), mapping_size);
+		if (fd >= 0) ::close (fd);
+		mapping = 0;
+		mapping_size = 0;
+		fd = -1;
+	}
+
+	void layout_store::map_file (std::size_t size) {
+		if (mapping != 0) munmap (const_cast< char * > (mapping), mapping_size);
+		void * m = mmap (0, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (m == MAP_FAILED) {
+			mapping = 0;
+			close_file ();
+			throw std::runtime_error (std::string ("layout_store: mmap: ") + std::strerror (errno));
+		}
+		mapping = static_cast< const char * > (m);
+		mapping_size = size;
+	}
+
+	// Writes go through the file descriptor : the shared mapping sees them
+	void layout_store::write_at (std::uint64_t offset, const void * data, std::size_t size) {
+		write_fd (fd, offset, data, size);
+	}
+
+	const layout_store::header & layout_store::file_header (void) const {
+		return *reinterpret_cast< const header * > (mapping);
+	}
+	const layout_store::slot * layout_store::slots (void) const {
+		return reinterpret_cast< const slot * > (mapping + sizeof (header));
+	}
+	const layout_store::record * layout_store::record_at (std::uint64_t offset) const {
+		std::uint64_t end = file_header ().end;
+		if (offset < index_end (file_header ().nb_slot) || offset % 8 != 0 || offset + sizeof (record) > end)
+			throw std::runtime_error ("layout_store: corrupted file");
+		const record * r = reinterpret_cast< const record * > (mapping + offset);
+		if (record_size (r->key_size, r->value_size) > end - offset)
+			throw std::runtime_error ("layout_store: corrupted file");
+		return r;
+	}
+
+	std::uint32_t layout_store::find (std::uint32_t kind, const std::string & key, std::uint64_t hash) const {
+		std::uint32_t mask = file_header ().nb_slot - 1;
+		for (std::uint32_t i = hash & mask;; i = (i + 1) & mask) {
+			const slot & s = slots ()[i];
+			if (s.offset == 0) return i;
+			if (s.hash != hash) continue;
+			const record * r = record_at (s.offset);
+			if (r->kind == kind && r->key_size == key.size () && std::memcmp (r->key (), key.data (), key.size ()) == 0) return i;
+		}
+	}
+
+	bool layout_store::get_record (std::uint32_t kind, const std::string & key, std::string & value) const {
+		const slot & s = slots ()[find (kind, key, key_hash (kind, key))];
+		if (s.offset == 0) return false;
+		const record * r = record_at (s.offset);
+		value.assign (r->value (), r->value_size);
+		return true;
+	}
+
+	std::uint64_t layout_store::previous_entry (const record * r) const {
+		std::uint64_t previous;
+		if (r->value_size < sizeof (previous))
+			throw std::runtime_error ("layout_store: corrupted file");
+		std::memcpy (&previous, r->value (), sizeof (previous));
+		return previous;
+	}
+
+	std::uint64_t layout_store::replaced_space (std::uint64_t offset) const {
+		std::uint64_t space = 0;
+		while (offset != 0) {
+			const record * r = record_at (offset);
+			space += record_size (r->key_size, r->value_size);
+			offset = r->kind == journal_record ? previous_entry (r) : 0;
+		}
+		return space;
+	}
+
+	void layout_store::put_record (std::uint32_t kind, const std::string & key, const std::string & value, bool keep_previous) {
+		std::uint64_t hash = key_hash (kind, key);
+		std::uint32_t i = find (kind, key, hash);
+		bool replace = slots ()[i].offset != 0;
+		if (not replace && 2 * (file_header ().nb_record + 1) > file_header ().nb_slot) {
+			rewrite (2 * file_header ().nb_slot);
+			i = find (kind, key, hash);
+		}
+
+		// Append record after used space
+		header h = file_header ();
+		std::uint64_t offset = h.end;
+		std::uint64_t size = record_size (key.size (), value.size ());
+		std::string data (size, '\0');
+		record r = { kind, std::uint32_t (key.size ()), std::uint32_t (value.size ()), 0 };
+		std::memcpy (&data[0], &r, sizeof (r));
+		std::memcpy (&data[sizeof (r)], key.data (), key.size ());
+		std::memcpy (&data[sizeof (r) + key.size ()], value.data (), value.size ());
+		if (offset + size > mapping_size) {
+			std::size_t new_size = std::max< std::uint64_t > (offset + size, 2 * mapping_size);
+			if (ftruncate (fd, new_size) != 0)
+				throw std::runtime_error (std::string ("layout_store: truncate: ") + std::strerror (errno));
+			map_file (new_size);
+		}
+		write_at (offset, data.data (), size);
+
+		// Then header, so that used space covers the record before it is referenced ; then the slot
+		if (replace) {
+			if (not keep_previous) h.dead += replaced_space (slots ()[i].offset);
+		} else {
+			h.nb_record++;
+			if (kind == layout_record) h.nb_layout++;
+		}
+		h.end = offset + size;
+		write_at (0, &h, sizeof (h));
+		slot s = { hash, offset };
+		write_at (sizeof (header) + std::uint64_t (i) * sizeof (slot), &s, sizeof (s));
+
+		if (h.dead > min_dead_space_rewrite && h.dead > h.end - h.dead)
+			rewrite (h.nb_slot);
+	}
+
+	void layout_store::rewrite (std::uint32_t nb_slot) {
+		// Live records in index order, placed in a new index
+		const header & current = file_header ();
+		header h = { file_magic, file_version, nb_slot, 0, 0, index_end (nb_slot), 0 };
+		std::vector< slot > new_slots (nb_slot, slot ());
+		std::string data;
+		for (std::uint32_t i = 0; i < current.nb_slot; ++i) {
+			const slot & s = slots ()[i];
+			if (s.offset == 0) continue;
+			const record * r = record_at (s.offset);
+			std::uint32_t j = s.hash & (nb_slot - 1);
+			while (new_slots[j].offset != 0) j = (j + 1) & (nb_slot - 1);
+			new_slots[j].hash = s.hash;
+
+			// Journal chains are copied oldest first, with new previous entry offsets
+			std::vector< const record * > chain (1, r);
+			while (chain.back ()->kind == journal_record && previous_entry (chain.back ()) != 0)
+				chain.push_back (record_at (previous_entry (chain.back ())));
+			std::uint64_t previous = 0;
+			for (std::size_t k = chain.size (); k-- > 0;) {
+				std::uint64_t offset = h.end + data.size ();
+				data.append (reinterpret_cast< const char * > (chain[k]), record_size (chain[k]->key_size, chain[k]->value_size));
+				if (chain[k]->kind == journal_record)
+					std::memcpy (&data[offset - h.end + sizeof (record) + chain[k]->key_size], &previous, sizeof (previous));
+				previous = offset;
+			}
+			new_slots[j].offset = previous;
+			h.nb_record++;
+			if (r->kind == layout_record) h.nb_layout++;
+		}
+		h.end += data.size ();
+
+		// Write a temporary file, and replace the current one
+		std::string temp = filename + ".temp";
+		int out = ::open (temp.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (out < 0)
+			throw std::runtime_error ("layout_store: unable to open '" + temp + "': " + std::strerror (errno));
+		try {
+			write_fd (out, 0, &h, sizeof (h));
+			write_fd (out, sizeof (header), new_slots.data (), new_slots.size () * sizeof (slot));
+			write_fd (out, index_end (nb_slot), data.data (), data.size ());
+		} catch (...) {
+			::close (out);
+			std::remove (temp.c_str ());
+			throw;
+		}
+		::close (out);
+		if (std::rename (temp.c_str (), filename.c_str ()) != 0) {
+			std::remove (temp.c_str ());
+			throw std::runtime_error (std::string ("layout_store: rename: ") + std::strerror (errno));
+		}
+		close_file ();
+		open_file ();
+	}
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef H_LAYOUT_STORE
+#define H_LAYOUT_STORE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace screen_layout {
+
+	class layout_store {
+		/*
+		 * Persistent map from edid sets to opaque layout records, in one memory mapped file.
+		 * Small named metadata records, and named journals, are stored in the same file.
+		 *
+		 * File format (native endian) :
+		 * - header : magic, version, index size, record counts, end of used space, dead space
+		 * - index : open addressing hash table of (key hash, record offset) slots, with linear probing
+		 * - records : kind, key size, value size, key (sorted edids separated by '\0'), value ; aligned to 8 bytes
+		 *
+		 * Opening only maps the file and checks its header, whatever the number of layouts.
+		 * A lookup hashes the key, and reads one probe run of the index and the matching record.
+		 * An update appends a record and then repoints its slot : a crash in between leaves the previous value.
+		 * Replaced records become dead space ; the file is rewritten when dead space exceeds live data, or the index gets half full.
+		 *
+		 * A journal is a chain of records, each one pointing to the previous : appending costs one small record.
+		 * An entry can restart the chain (typically a snapshot of the state), which makes all previous entries dead space.
+		 * Not thread safe.
+		 */
+		public:
+			typedef std::vector< std::string > edid_set;
+
+			explicit layout_store (const std::string & filename); // Created if missing ; throws std::runtime_error if invalid
+			~layout_store (void);
+
+			bool get (const edid_set & edids, std::string & value) const;
+			void put (const edid_set & edids, const std::string & value);
+
+			bool get_metadata (const std::string & name, std::string & value) const;
+			void put_metadata (const std::string & name, const std::string & value);
+
+			// Entries since the last restart, oldest first
+			std::vector< std::string > read_journal (const std::string & name) const;
+			void append_journal (const std::string & name, const std::string & value, bool restart);
+
+			std::size_t size (void) const; // Number of layouts
+			std::vector< edid_set > keys (void) const;
+
+		private:
+			enum record_kind { layout_record = 0, metadata_record = 1, journal_record = 2 }; // Journal values start with the previous entry offset
+			struct header;
+			struct slot;
+			struct record;
+			static std::uint64_t record_size (std::size_t key_size, std::size_t value_size);
+			static std::uint64_t index_end (std::uint32_t nb_slot); // Offset of the first record
+
+			std::string filename;
+			int fd;
+			const char * mapping;
+			std::size_t mapping_size;
+
+			void open_file (void);
+			void close_file (void);
+			void map_file (std::size_t size);
+			void write_at (std::uint64_t offset, const void * data, std::size_t size);
+
+			const header & file_header (void) const;
+			const slot * slots (void) const;
+			const record * record_at (std::uint64_t offset) const;
+
+			// Slot index of the key, or of the empty slot ending its probe run
+			std::uint32_t find (std::uint32_t kind, const std::string & key, std::uint64_t hash) const;
+			bool get_record (std::uint32_t kind, const std::string & key, std::string & value) const;
+			void put_record (std::uint32_t kind, const std::string & key, const std::string & value, bool keep_previous = false);
+			std::uint64_t replaced_space (std::uint64_t offset) const; // Record size, or chain size for journals
+			std::uint64_t previous_entry (const record * r) const;
+
+			void rewrite (std::uint32_t nb_slot); // Copy live records to a new file with nb_slot index slots
+
+			layout_store (const layout_store &);
+			layout_store & operator= (const layout_store &);
+	};
+}
+
+#endif
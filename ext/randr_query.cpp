@@ -0,0 +1,217 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "randr_query.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <xcb/xcb.h>
+#include <xcb/randr.h>
+
+namespace screen_layout {
+
+	// Replies are allocated by xcb with malloc
+	struct free_deleter {
+		void operator() (void * p) const { std::free (p); }
+	};
+	template< typename T > using xcb_reply = std::unique_ptr< T, free_deleter >;
+
+	// Requests for the crtc and output lists given to send_batch, in the same order
+	struct randr_batch {
+		std::vector< std::uint32_t > crtc_ids, output_ids;
+		std::vector< xcb_randr_get_crtc_info_cookie_t > crtcs;
+		std::vector< xcb_randr_get_output_info_cookie_t > outputs;
+		std::vector< xcb_randr_get_output_property_cookie_t > edids;
+	};
+
+	static void send_batch (xcb_connection_t * conn, const std::vector< std::uint32_t > & crtc_ids, const std::vector< std::uint32_t > & output_ids,
+			std::uint32_t config_timestamp, std::uint32_t edid_atom, randr_batch & batch) {
+		batch.crtc_ids = crtc_ids;
+		batch.output_ids = output_ids;
+		for (unsigned c = 0; c < crtc_ids.size (); ++c)
+			batch.crtcs.push_back (xcb_randr_get_crtc_info (conn, crtc_ids[c], config_timestamp));
+		for (unsigned o = 0; o < output_ids.size (); ++o) {
+			batch.outputs.push_back (xcb_randr_get_output_info (conn, output_ids[o], config_timestamp));
+			batch.edids.push_back (xcb_randr_get_output_property (conn, output_ids[o], edid_atom, XCB_GET_PROPERTY_TYPE_ANY, 0, 10000, 0, 0));
+		}
+	}
+
+	static void discard_batch (xcb_connection_t * conn, const randr_batch & batch) {
+		for (unsigned c = 0; c < batch.crtcs.size (); ++c) xcb_discard_reply (conn, batch.crtcs[c].sequence);
+		for (unsigned o = 0; o < batch.outputs.size (); ++o) {
+			xcb_discard_reply (conn, batch.outputs[o].sequence);
+			xcb_discard_reply (conn, batch.edids[o].sequence);
+		}
+	}
+
+	// Null reply, and frees the error ; a connection failure throws
+	template< typename T > static T * checked_reply (xcb_connection_t * conn, T * reply, xcb_generic_error_t * error) {
+		if (error != 0) {
+			std::free (error);
+			std::free (reply);
+			return 0;
+		}
+		if (reply == 0 && xcb_connection_has_error (conn))
+			throw std::runtime_error ("randr_query: connection lost");
+		return reply;
+	}
+
+	// Reads all replies (also after a failure, so that none is left pending) ; returns false if the configuration changed
+	static bool read_batch (xcb_connection_t * conn, const randr_batch & batch, randr_state & state) {
+		bool valid = true;
+		state.crtcs.assign (batch.crtc_ids.size (), randr_crtc ());
+		for (unsigned c = 0; c < batch.crtcs.size (); ++c) {
+			xcb_generic_error_t * error = 0;
+			xcb_reply< xcb_randr_get_crtc_info_reply_t > reply (checked_reply (conn, xcb_randr_get_crtc_info_reply (conn, batch.crtcs[c], &error), error));
+			if (not reply || reply->status != XCB_RANDR_SET_CONFIG_SUCCESS) {
+				valid = false;
+				continue;
+			}
+			randr_crtc & crtc = state.crtcs[c];
+			crtc.id = batch.crtc_ids[c];
+			crtc.x = reply->x; crtc.y = reply->y;
+			crtc.width = reply->width; crtc.height = reply->height;
+			crtc.mode = reply->mode;
+			crtc.rotation = reply->rotation; crtc.rotations = reply->rotations;
+			const xcb_randr_output_t * outputs = xcb_randr_get_crtc_info_outputs (reply.get ());
+			crtc.outputs.assign (outputs, outputs + xcb_randr_get_crtc_info_outputs_length (reply.get ()));
+			const xcb_randr_output_t * possible = xcb_randr_get_crtc_info_possible (reply.get ());
+			crtc.possible.assign (possible, possible + xcb_randr_get_crtc_info_possible_length (reply.get ()));
+		}
+
+		state.outputs.assign (batch.output_ids.size (), randr_output ());
+		for (unsigned o = 0; o < batch.outputs.size (); ++o) {
+			randr_output & output = state.outputs[o];
+			output.id = batch.output_ids[o];
+
+			xcb_generic_error_t * error = 0;
+			xcb_reply< xcb_randr_get_output_info_reply_t > reply (checked_reply (conn, xcb_randr_get_output_info_reply (conn, batch.outputs[o], &error), error));
+			if (not reply || reply->status != XCB_RANDR_SET_CONFIG_SUCCESS) {
+				valid = false;
+			} else {
+				const char * name = reinterpret_cast< const char * > (xcb_randr_get_output_info_name (reply.get ()));
+				output.name.assign (name, xcb_randr_get_output_info_name_length (reply.get ()));
+				output.connection = reply->connection;
+				output.crtc = reply->crtc;
+				output.mm_width = reply->mm_width; output.mm_height = reply->mm_height;
+				output.num_preferred = reply->num_preferred;
+				const xcb_randr_crtc_t * crtcs = xcb_randr_get_output_info_crtcs (reply.get ());
+				output.crtcs.assign (crtcs, crtcs + xcb_randr_get_output_info_crtcs_length (reply.get ()));
+				const xcb_randr_mode_t * modes = xcb_randr_get_output_info_modes (reply.get ());
+				output.modes.assign (modes, modes + xcb_randr_get_output_info_modes_length (reply.get ()));
+				const xcb_randr_output_t * clones = xcb_randr_get_output_info_clones (reply.get ());
+				output.clones.assign (clones, clones + xcb_randr_get_output_info_clones_length (reply.get ()));
+			}
+
+			error = 0;
+			xcb_reply< xcb_randr_get_output_property_reply_t > edid (checked_reply (conn, xcb_randr_get_output_property_reply (conn, batch.edids[o], &error), error));
+			if (not edid) {
+				valid = false;
+			} else if (edid->format == 8 && edid->type == XCB_ATOM_INTEGER && edid->bytes_after == 0 && edid->num_items > 0) {
+				const char * data = reinterpret_cast< const char * > (xcb_randr_get_output_property_data (edid.get ()));
+				output.edid.assign (data, xcb_randr_get_output_property_data_length (edid.get ()));
+			}
+		}
+		return valid;
+	}
+
+	randr_query::randr_query (const std::string & display, std::uint32_t _root) :
+		conn (0), root (_root), edid_atom (0), known_config_timestamp (0), last_round_trips (0)
+	{
+		conn = xcb_connect (display.empty () ? 0 : display.c_str (), 0);
+		if (xcb_connection_has_error (conn)) {
+			xcb_disconnect (conn);
+			throw std::runtime_error ("randr_query: unable to connect to display");
+		}
+
+		// Version must be announced before using RandR 1.2 requests
+		xcb_randr_query_version_cookie_t version_cookie = xcb_randr_query_version (conn, 1, 3);
+		const char edid_name[] = "EDID";
+		xcb_intern_atom_cookie_t atom_cookie = xcb_intern_atom (conn, 0, std::strlen (edid_name), edid_name);
+		xcb_reply< xcb_randr_query_version_reply_t > version (xcb_randr_query_version_reply (conn, version_cookie, 0));
+		xcb_reply< xcb_intern_atom_reply_t > atom (xcb_intern_atom_reply (conn, atom_cookie, 0));
+		if (not version || not atom || version->major_version < 1 || (version->major_version == 1 && version->minor_version < 3)) {
+			xcb_disconnect (conn);
+			throw std::runtime_error ("randr_query: RandR >= 1.3 not available");
+		}
+		edid_atom = atom->atom;
+	}
+
+	randr_query::~randr_query (void) {
+		xcb_disconnect (conn);
+	}
+
+	bool randr_query::query (randr_state & state) {
+		xcb_randr_get_screen_resources_cookie_t resources_cookie = xcb_randr_get_screen_resources (conn, root);
+		xcb_get_geometry_cookie_t geometry_cookie = xcb_get_geometry (conn, root);
+		randr_batch speculative;
+		send_batch (conn, known_crtcs, known_outputs, known_config_timestamp, edid_atom, speculative);
+		xcb_flush (conn);
+		last_round_trips = 1;
+
+		xcb_generic_error_t * error = 0;
+		xcb_reply< xcb_randr_get_screen_resources_reply_t > resources (checked_reply (conn, xcb_randr_get_screen_resources_reply (conn, resources_cookie, &error), error));
+		error = 0;
+		xcb_reply< xcb_get_geometry_reply_t > geometry (checked_reply (conn, xcb_get_geometry_reply (conn, geometry_cookie, &error), error));
+		if (not resources || not geometry) {
+			discard_batch (conn, speculative);
+			throw std::runtime_error ("randr_query: unable to get screen resources of root window");
+		}
+
+		state.timestamp = resources->timestamp;
+		state.config_timestamp = resources->config_timestamp;
+		state.width = geometry->width;
+		state.height = geometry->height;
+		state.modes.clear ();
+		for (xcb_randr_mode_info_iterator_t it = xcb_randr_get_screen_resources_modes_iterator (resources.get ()); it.rem > 0; xcb_randr_mode_info_next (&it)) {
+			randr_mode mode;
+			mode.id = it.data->id;
+			mode.width = it.data->width; mode.height = it.data->height;
+			mode.dot_clock = it.data->dot_clock;
+			mode.htotal = it.data->htotal; mode.vtotal = it.data->vtotal;
+			state.modes.push_back (mode);
+		}
+
+		const xcb_randr_crtc_t * crtcs = xcb_randr_get_screen_resources_crtcs (resources.get ());
+		std::vector< std::uint32_t > crtc_ids (crtcs, crtcs + xcb_randr_get_screen_resources_crtcs_length (resources.get ()));
+		const xcb_randr_output_t * outputs = xcb_randr_get_screen_resources_outputs (resources.get ());
+		std::vector< std::uint32_t > output_ids (outputs, outputs + xcb_randr_get_screen_resources_outputs_length (resources.get ()));
+
+		// Speculative requests are valid for the same lists ; replies tell if the configuration timestamp was too old
+		bool same_lists = crtc_ids == known_crtcs && output_ids == known_outputs;
+		known_crtcs = crtc_ids;
+		known_outputs = output_ids;
+		known_config_timestamp = state.config_timestamp;
+		if (same_lists) {
+			if (read_batch (conn, speculative, state)) return true;
+		} else {
+			discard_batch (conn, speculative);
+		}
+
+		randr_batch batch;
+		send_batch (conn, crtc_ids, output_ids, state.config_timestamp, edid_atom, batch);
+		xcb_flush (conn);
+		last_round_trips = 2;
+		return read_batch (conn, batch, state);
+	}
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2013-2015 Francois GINDRAUD
+// 
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef H_RANDR_QUERY
+#define H_RANDR_QUERY
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct xcb_connection_t;
+
+namespace screen_layout {
+
+	// RandR state of a screen ; names follow the xcb reply fields, so that python code can use them the same way
+	struct randr_mode {
+		std::uint32_t id;
+		std::uint16_t width, height;
+		std::uint32_t dot_clock;
+		std::uint16_t htotal, vtotal;
+	};
+
+	struct randr_crtc {
+		std::uint32_t id;
+		std::int16_t x, y;
+		std::uint16_t width, height;
+		std::uint32_t mode;
+		std::uint16_t rotation, rotations;
+		std::vector< std::uint32_t > outputs, possible;
+	};
+
+	struct randr_output {
+		std::uint32_t id;
+		std::string name;
+		std::uint8_t connection;
+		std::uint32_t crtc;
+		std::uint32_t mm_width, mm_height;
+		std::uint16_t num_preferred;
+		std::vector< std::uint32_t > crtcs, modes, clones;
+		std::string edid; // Raw EDID property (empty if missing, or not a list of 8 bit integers)
+	};
+
+	struct randr_state {
+		std::uint32_t timestamp, config_timestamp;
+		std::uint16_t width, height; // Root window size (virtual screen)
+		std::vector< randr_mode > modes;
+		std::vector< randr_crtc > crtcs;
+		std::vector< randr_output > outputs;
+	};
+
+	class randr_query {
+		/*
+		 * Queries the whole RandR state of a screen (resources, crtcs, outputs and their EDID) on its own xcb connection.
+		 *
+		 * Crtc, output and EDID requests need the crtc and output lists of the screen resources.
+		 * They are sent for the lists of the previous query, pipelined with the resources request, before reading any reply.
+		 * If the lists did not change (usual case : outputs exist even when disconnected), a query is one round trip.
+		 * Otherwise (or if a reply reports an outdated config timestamp), requests are sent again for the new resources.
+		 */
+		public:
+			randr_query (const std::string & display, std::uint32_t root); // Empty display is the default one ; throws std::runtime_error
+			~randr_query (void);
+
+			// Returns false if the configuration changed during the query (invalid config timestamp, or object removed)
+			bool query (randr_state & state);
+
+			int nb_round_trip (void) const { return last_round_trips; } // Of the last query
+
+		private:
+			xcb_connection_t * conn;
+			std::uint32_t root;
+			std::uint32_t edid_atom;
+			std::uint32_t known_config_timestamp;
+			std::vector< std::uint32_t > known_crtcs, known_outputs;
+			int last_round_trips;
+
+			randr_query (const randr_query &);
+			randr_query & operator= (const randr_query &);
+	};
+}
+
+#endif
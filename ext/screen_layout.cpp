@@ -22,64 +22,552 @@
 #include "screen_layout.h"
 
 #include <algorithm>
+#include <array>
 #include <stdexcept>
 #include <limits>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <unordered_map>
+#include <cmath>
+#include <cstdlib>
+#include <random>
 #include <isl/set.h>
 #include <isl/space.h>
 #include <isl/constraint.h>
+#include <poll.h>
 
 namespace screen_layout {
 
-	class sequence_pair {
+	bool cancellation_token::cancelled (void) const {
+		if (requested || (parent && parent->cancelled ())) return true;
+		int fd = watched_fd;
+		if (fd < 0) return false;
+		struct pollfd p = { fd, POLLIN, 0 };
+		return poll (&p, 1, 0) > 0 && (p.revents & (POLLIN | POLLHUP)) != 0;
+	}
+
+	// Per screen storage : fixed size array for a compile time screen count N, or vector if N = 0 (runtime count)
+	template< typename T, int N > struct screen_array {
+		typedef std::array< T, N > type;
+		static type make (int, const T & value) { type a; a.fill (value); return a; }
+	};
+	template< typename T > struct screen_array< T, 0 > {
+		typedef std::vector< T > type;
+		static type make (int size, const T & value) { return type (size, value); }
+	};
+
+	template< int N > class basic_constrained_permutation {
+		/*
+		 * Lexicographic enumeration of permutations of positions offsets, restricted by a partial order.
+		 *
+		 * Positions are assigned by increasing item index, and each new position is checked against items already placed.
+		 * An incompatible prefix thus discards its whole subtree, instead of generating and filtering all its permutations.
+		 *
+		 * Checks use item bitmasks (up to 64 items) : requirements are compiled to masks of items that must be before / after each item,
+		 * and the occupant of each position is kept, so that items placed below a candidate position are a running OR.
+		 * A candidate position is then checked with two AND operations.
+		 *
+		 * N > 0 fixes the size at compile time : no heap allocation, and loops have constant bounds (unrolled).
+		 */
+		public:
+			typedef typename screen_array< int, N >::type index_vector;
+			typedef unsigned long long mask;
+
+			basic_constrained_permutation (int _size) :
+				dynamic_size (_size), placed (0),
+				values (screen_array< int, N >::make (_size, 0)), occupant (screen_array< mask, N >::make (_size, 0)),
+				required_before (screen_array< mask, N >::make (_size, 0)), required_after (screen_array< mask, N >::make (_size, 0)) {}
+
+			// Require item i to be placed before item j in the sequence
+			void require_before (int i, int j) { required_after[i] |= bit (j); required_before[j] |= bit (i); }
+
+			bool first (void) {
+				std::fill (occupant.begin (), occupant.end (), 0);
+				placed = 0;
+				return assign (0, 0);
+			}
+			bool next (void) {
+				for (int i = size () - 1; i >= 0; --i) {
+					occupant[values[i]] = 0;
+					placed &= ~bit (i);
+					if (assign (i, values[i] + 1)) return true;
+				}
+				return false;
+			}
+
+			int operator[] (int i) const { return values[i]; }
+
+		private:
+			int dynamic_size;
+			mask placed; // Items with a position
+			index_vector values;
+			typename screen_array< mask, N >::type occupant; // Item bit at each position, 0 if free
+			typename screen_array< mask, N >::type required_before, required_after; // Items that must be before / after each item
+
+			int size (void) const { return N > 0 ? N : dynamic_size; }
+			static mask bit (int i) { return mask (1) << i; }
+
+			// Place items i.. with positions starting at from for item i
+			bool assign (int i, int from) {
+				if (i == size ()) return true;
+				mask below = 0; // Items placed at positions lower than v
+				for (int v = 0; v < from; ++v) below |= occupant[v];
+				for (int v = from; v < size (); below |= occupant[v], ++v) {
+					if (occupant[v] != 0) continue;
+					mask above = placed & ~below;
+					if ((below & required_after[i]) != 0 || (above & required_before[i]) != 0) continue;
+					values[i] = v; occupant[v] = bit (i); placed |= bit (i);
+					if (assign (i + 1, 0)) return true;
+					occupant[v] = 0; placed &= ~bit (i);
+				}
+				return false;
+			}
+	};
+	typedef basic_constrained_permutation< 0 > constrained_permutation;
+
+	class layout_template {
+		/*
+		 * Relations of a screen layout template, packed as 2 bits per screen pair (dir - 1).
+		 * Pairs (sa, sb) with sb < sa are indexed in row order, which fits 8 screens in 64 bits.
+		 */
+		public:
+			typedef unsigned long long packed;
+			enum { max_screen = 8 };
+
+			layout_template (void) : relations (0) {}
+
+			static int pair_index (int sa, int sb) { return (sa * (sa - 1)) / 2 + sb; }
+
+			// Requires sb < sa
+			dir ordering (int sa, int sb) const { return dir (((relations >> (2 * pair_index (sa, sb))) & 3) + 1); }
+			void set_ordering (int sa, int sb, dir d) {
+				int shift = 2 * pair_index (sa, sb);
+				relations = (relations & ~(packed (3) << shift)) | (packed (d - 1) << shift);
+			}
+
+			// True if relations selected by mask are the ones of value
+			bool matches (packed mask, packed value) const { return (relations & mask) == value; }
+
+		private:
+			packed relations;
+	};
+
+	// Screen order in sequences a and b required by a user constraint on (sa, sb) ; returns false if none
+	static bool sequence_requirement (dir constraint, bool & sa_first_in_a, bool & sa_first_in_b) {
+		switch (constraint) {
+			case none: return false;
+			case left: sa_first_in_a = true; sa_first_in_b = true; return true;
+			case right: sa_first_in_a = false; sa_first_in_b = false; return true;
+			case above: sa_first_in_a = true; sa_first_in_b = false; return true;
+			case under: sa_first_in_a = false; sa_first_in_b = true; return true;
+			default: throw std::runtime_error ("sequence_pair: invalid user constraint");
+		}
+	}
+
+	// Relation of sa to sb given their position differences (position of sb minus position of sa) in sequences a and b
+	static inline dir sequence_ordering (int a_diff, int b_diff) {
+		if (a_diff > 0) return b_diff > 0 ? left : above;
+		else return b_diff > 0 ? under : right;
+	}
+
+	template< int N > class basic_sequence_pair {
 		/* 
 		 * Sequence pair enumeration of screen layout template (relations between screens but no absolute positionning)
 		 * cf doc (packing paper)
 		 *
 		 * Instead of computing permutations of items [screen ids], we compute permutations of items positions offsets.
 		 * This is equivalent (bijection with items themselves), but let us compute item order very fast.
+		 *
+		 * Each screen relation fixes the order of the two screens in both a and b sequences independently.
+		 * User constraints are thus enforced during enumeration, and only compatible templates are generated.
+		 * Enumeration order is lexicographic, with b as the outer sequence.
+		 *
+		 * N > 0 is a compile time screen count, as in basic_constrained_permutation.
 		 */
 		public:
-			typedef std::vector< int > index_vector;
+			basic_sequence_pair (int _size, const setting & user_constraints) : dynamic_size (_size), a (_size), b (_size) {
+				for (int sa = 0; sa < size (); ++sa)
+					for (int sb = 0; sb < sa; ++sb) {
+						bool sa_first_in_a, sa_first_in_b;
+						if (sequence_requirement (user_constraints[sa][sb], sa_first_in_a, sa_first_in_b)) {
+							if (sa_first_in_a) a.require_before (sa, sb); else a.require_before (sb, sa);
+							if (sa_first_in_b) b.require_before (sa, sb); else b.require_before (sb, sa);
+						}
+					}
+			}
+
+			// Returns false if no template is compatible with user constraints
+			bool first (void) { return a.first () && b.first (); }
+			bool next (void) { return a.next () || (b.next () && a.first ()); }
 
-			sequence_pair (int size) : a (size), b (size) { for (int i = 0; i < size; ++i) a[i] = b[i] = i; }
-			bool next (void) { return std::next_permutation (a.begin (), a.end ()) || std::next_permutation (b.begin (), b.end ()); }
+			dir ordering (int sa, int sb) const { return sequence_ordering (a[sb] - a[sa], b[sb] - b[sa]); }
 
-			dir ordering (int sa, int sb) const {
-				int left_diff = a[sb] - a[sa]; int right_diff = b[sb] - b[sa];
-				if (left_diff > 0) return right_diff > 0 ? left : above;
-				else return right_diff > 0 ? under : right;
+			layout_template relations (void) const {
+				layout_template t;
+				for (int sa = 0; sa < size (); ++sa)
+					for (int sb = 0; sb < sa; ++sb)
+						t.set_ordering (sa, sb, ordering (sa, sb));
+				return t;
 			}
+
+			// Positions of screen s in sequences
+			int position_a (int s) const { return a[s]; }
+			int position_b (int s) const { return b[s]; }
+
 		private:
-			index_vector a, b;
+			int dynamic_size;
+			basic_constrained_permutation< N > a, b;
+
+			int size (void) const { return N > 0 ? N : dynamic_size; }
 	};
+	typedef basic_sequence_pair< 0 > sequence_pair;
 
-	class rectangle_packer {
+	/*
+	 * Precomputed templates for small screen counts.
+	 *
+	 * Sequence pairs and templates are in bijection, so the table holds all (N!)^2 templates in enumeration order.
+	 * It is built once per process on first use, and a search keeps the templates matching the user constraint mask.
+	 * Filtering keeps the enumeration order : constrained enumeration of each sequence is a subsequence of the full one.
+	 */
+	template< int N > static std::vector< layout_template > make_template_table (void) {
+		std::vector< layout_template > table;
+		basic_sequence_pair< N > seq_pair (N, setting (N));
+		for (bool more = seq_pair.first (); more; more = seq_pair.next ())
+			table.push_back (seq_pair.relations ());
+		return table;
+	}
+	template< int N > static const std::vector< layout_template > & template_table (void) {
+		static const std::vector< layout_template > table = make_template_table< N > ();
+		return table;
+	}
+
+	// Mask and value of the template relations fixed by user constraints
+	static void constraint_signature (int nb_screen, const setting & user_constraints, layout_template::packed & mask, layout_template::packed & value) {
+		mask = value = 0;
+		for (int sa = 0; sa < nb_screen; ++sa)
+			for (int sb = 0; sb < sa; ++sb) {
+				bool sa_first_in_a, sa_first_in_b;
+				dir constraint = user_constraints[sa][sb];
+				if (sequence_requirement (constraint, sa_first_in_a, sa_first_in_b)) {
+					int shift = 2 * layout_template::pair_index (sa, sb);
+					mask |= layout_template::packed (3) << shift;
+					value |= layout_template::packed (constraint - 1) << shift;
+				}
+			}
+	}
+
+	class minimal_change_permutation {
+		/*
+		 * Permutations of items in Steinhaus-Johnson-Trotter order (one adjacent transposition per step), with required orders.
+		 *
+		 * A permutation is built from its rank, as in Even's order : item k is inserted among the permutation of smaller items,
+		 * sweeping right to left for even ranks of that smaller permutation, and left to right for odd ones.
+		 * Smaller items keep their relative order when larger ones are inserted : a required order violated by item k excludes
+		 * the whole block of ranks sharing the permutation of items up to k, which is skipped without being built.
+		 * Steps go both ways, and no permutation is stored.
+		 */
+		public:
+			explicit minimal_change_permutation (int _size) :
+				size (_size), nb_rank (1), rank (0), required (_size * _size, 0), block_size (_size), sub_rank (_size), digit (_size), sequence (_size), candidate (_size), position (_size)
+			{
+				for (int k = 2; k <= size; ++k) nb_rank *= k;
+				long permutations_up_to_k = 1;
+				for (int k = 0; k < size; ++k) {
+					permutations_up_to_k *= k + 1;
+					block_size[k] = nb_rank / permutations_up_to_k;
+				}
+			}
+
+			void require_before (int first, int second) {
+				required[first * size + second] = 1;
+				required[second * size + first] = -1;
+			}
+
+			// Return false if there is no such permutation (the current one is then kept)
+			bool first (void) { return seek (0, 1); }
+			bool last (void) { return seek (nb_rank - 1, -1); }
+			bool next (void) { return seek (rank + 1, 1); }
+			bool previous (void) { return seek (rank - 1, -1); }
+
+			// Position of item in the permutation
+			int operator[] (int item) const { return position[item]; }
+
+		private:
+			int size;
+			long nb_rank;
+			long rank;
+			std::vector< signed char > required; // required[i * size + j] : 1 if i must be before j, -1 if after
+			std::vector< long > block_size; // Ranks sharing the same permutation of items up to k
+			std::vector< long > sub_rank;
+			std::vector< int > digit;
+			std::vector< int > sequence, candidate, position; // Items by position (current and in construction), positions by item
+
+			// Nearest rank from r in direction with a compatible permutation
+			bool seek (long r, int direction) {
+				while (r >= 0 && r < nb_rank) {
+					int level = build (r);
+					if (level < 0) {
+						rank = r;
+						sequence.swap (candidate);
+						for (int p = 0; p < size; ++p) position[sequence[p]] = p;
+						return true;
+					}
+					long block = r / block_size[level];
+					r = direction > 0 ? (block + 1) * block_size[level] : block * block_size[level] - 1;
+				}
+				return false;
+			}
+
+			// Builds the permutation of rank r in candidate ; returns -1, or the first item violating a required order
+			int build (long r) {
+				long q = r;
+				for (int k = size - 1; k > 0; --k) {
+					sub_rank[k] = q;
+					digit[k] = q % (k + 1);
+					q /= k + 1;
+				}
+				if (size == 0) return -1;
+				sub_rank[0] = 0; // Permutation of item 0 alone
+				candidate[0] = 0;
+				for (int k = 1; k < size; ++k) {
+					int index = sub_rank[k - 1] % 2 == 0 ? k - digit[k] : digit[k];
+					for (int p = k; p > index; --p) candidate[p] = candidate[p - 1];
+					candidate[index] = k;
+					for (int p = 0; p <= k; ++p) {
+						signed char order = required[k * size + candidate[p]];
+						if ((order > 0 && p < index) || (order < 0 && p > index)) return k;
+					}
+				}
+				return -1;
+			}
+	};
+
+	class minimal_change_sequence_pair {
+		/*
+		 * Sequence pair enumeration in minimal change order, instead of lexicographic.
+		 *
+		 * Permutations of positions offsets follow the Steinhaus-Johnson-Trotter order : each step is one adjacent transposition.
+		 * The pair is a boustrophedon product : a goes forward for one b permutation and backward for the next one.
+		 * Each step thus changes one sequence by one transposition, which changes the ordering of a single screen pair.
+		 * Permutations incompatible with user constraints are skipped, so a step may combine several transpositions.
+		 * Pairs whose ordering changed at the last step (all of them, by comparing positions) are reported,
+		 * so that users update a template instead of rebuilding it.
+		 */
+		public:
+			typedef std::pair< int, int > screen_pair; // (sa, sb) with sb < sa
+
+			minimal_change_sequence_pair (int _size, const setting & user_constraints) : nb_screen (_size), a (_size), b (_size), forward (true), previous (_size) {
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb) {
+						bool sa_first_in_a, sa_first_in_b;
+						if (sequence_requirement (user_constraints[sa][sb], sa_first_in_a, sa_first_in_b)) {
+							if (sa_first_in_a) a.require_before (sa, sb); else a.require_before (sb, sa);
+							if (sa_first_in_b) b.require_before (sa, sb); else b.require_before (sb, sa);
+						}
+					}
+			}
+
+			// Returns false if no template is compatible with user constraints
+			bool first (void) {
+				forward = true;
+				changed.clear ();
+				return a.first () && b.first ();
+			}
+			bool next (void) {
+				changed.clear ();
+				save (a);
+				if (forward ? a.next () : a.previous ()) {
+					changed_since_save (a);
+					return true;
+				}
+				save (b);
+				if (not b.next ()) return false;
+				forward = not forward;
+				changed_since_save (b);
+				return true;
+			}
+
+			const std::vector< screen_pair > & changed_pairs (void) const { return changed; }
+
+			// Positions of screen s in sequences
+			int position_a (int s) const { return a[s]; }
+			int position_b (int s) const { return b[s]; }
+
+			dir ordering (int sa, int sb) const { return sequence_ordering (position_a (sb) - position_a (sa), position_b (sb) - position_b (sa)); }
+
+			layout_template relations (void) const {
+				layout_template t;
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb)
+						t.set_ordering (sa, sb, ordering (sa, sb));
+				return t;
+			}
+			void update_relations (layout_template & t) const {
+				for (unsigned i = 0; i < changed.size (); ++i)
+					t.set_ordering (changed[i].first, changed[i].second, ordering (changed[i].first, changed[i].second));
+			}
+
+		private:
+			int nb_screen;
+			minimal_change_permutation a, b;
+			bool forward; // Direction of a for the current b
+			std::vector< int > previous; // Positions of the moved sequence before the step
+			std::vector< screen_pair > changed;
+
+			void save (const minimal_change_permutation & sequence) {
+				for (int s = 0; s < nb_screen; ++s) previous[s] = sequence[s];
+			}
+			void changed_since_save (const minimal_change_permutation & sequence) {
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb)
+						if ((previous[sb] > previous[sa]) != (sequence[sb] > sequence[sa])) changed.push_back (screen_pair (sa, sb));
+			}
+	};
+
+	class constraint_set {
 		/* [ISL]
-		 * For each screen layout template, instantiate it by computing coordinates.
-		 * Metric is : sum of distance between centers of each related screen.
+		 * Polyhedron on the packer variables, with helpers for the kinds of constraints we use.
+		 * The local space is borrowed (owned by the packer context).
+		 */
+		public:
+			constraint_set (isl_local_space * _ls, isl_set * _solutions) : ls (_ls), solutions (_solutions) {}
+			~constraint_set (void) { if (solutions != 0) isl_set_free (solutions); }
+
+			isl_set * release (void) { isl_set * s = solutions; solutions = 0; return s; }
+
+			// Polyhedral contraints
+			void positive_or_zero (int v) { // 0 <= v
+				more_than_const (v, 0);
+			}
+			void more_than_const (int v, int constant) { // constant <= v
+				isl_constraint * more = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
+				more = isl_constraint_set_coefficient_si (more, isl_dim_set, v, 1);
+				more = isl_constraint_set_constant_si (more, -constant);
+				solutions = isl_set_add_constraint (solutions, more); 
+			}
+			void less_than_const (int v, int constant) { // v <= constant
+				isl_constraint * less = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
+				less = isl_constraint_set_coefficient_si (less, isl_dim_set, v, -1);
+				less = isl_constraint_set_constant_si (less, constant);
+				solutions = isl_set_add_constraint (solutions, less); 
+			}
+			void offseted_less_than_var (int v, int offset, int v2) { // v + offset <= v2
+				isl_constraint * less = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
+				less = isl_constraint_set_coefficient_si (less, isl_dim_set, v, -1);
+				less = isl_constraint_set_constant_si (less, -offset);
+				less = isl_constraint_set_coefficient_si (less, isl_dim_set, v2, 1);
+				solutions = isl_set_add_constraint (solutions, less);
+			}
+			void offseted_diff_less_than_var (int va, int vb, int offset, int mv) { // va - vb + offset <= mv
+				isl_constraint * less = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
+				less = isl_constraint_set_coefficient_si (less, isl_dim_set, va, -1);
+				less = isl_constraint_set_coefficient_si (less, isl_dim_set, vb, 1);
+				less = isl_constraint_set_constant_si (less, -offset);
+				less = isl_constraint_set_coefficient_si (less, isl_dim_set, mv, 1);
+				solutions = isl_set_add_constraint (solutions, less);
+			}
+			void equality (const std::vector< int > & coeffs) {
+				isl_constraint * equ = isl_constraint_alloc_equality (isl_local_space_copy (ls));
+				for (unsigned c = 0; c < coeffs.size (); ++c)
+					equ = isl_constraint_set_coefficient_si (equ, isl_dim_set, c, coeffs[c]);
+				solutions = isl_set_add_constraint (solutions, equ);
+			}
+
+		private:
+			isl_local_space * ls;
+			isl_set * solutions;
+
+			constraint_set (const constraint_set &);
+			constraint_set & operator= (const constraint_set &);
+	};
+
+	class rectangle_packer_context {
+		/* [ISL]
+		 * Solver state shared by all templates of a search : context, variable space and base polyhedron.
+		 * The base polyhedron holds the template independent constraints (virtual screen bounds, screens inside virtual screen).
+		 * An isl_ctx must not be used concurrently, so each search worker builds its own.
 		 */
 		public:
-			rectangle_packer (int _nb_screen, const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const sequence_pair & layout) : nb_screen (_nb_screen) {
-				init_solver ();
+			enum axis { X = 1, Y = 0, Next = 2 }; // Always place Y before X, so that height is minimized
+
+			rectangle_packer_context (int _nb_screen, const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & _screen_sizes) :
+				nb_screen (_nb_screen), screen_sizes (_screen_sizes)
+			{
+				context = isl_ctx_alloc ();
+				isl_space * vars = isl_space_set_alloc (context, 0, v_nb ());
+				ls = isl_local_space_from_space (isl_space_copy (vars));
+				constraint_set base_set (ls, isl_set_universe (vars));
 
 				// Virtual screen boundaries
-				more_than_const (v_vscreen_size (X), vscreen_min_size.x); less_than_const (v_vscreen_size (X), vscreen_max_size.x);
-				more_than_const (v_vscreen_size (Y), vscreen_min_size.y); less_than_const (v_vscreen_size (Y), vscreen_max_size.y);
+				base_set.more_than_const (v_vscreen_size (X), vscreen_min_size.x); base_set.less_than_const (v_vscreen_size (X), vscreen_max_size.x);
+				base_set.more_than_const (v_vscreen_size (Y), vscreen_min_size.y); base_set.less_than_const (v_vscreen_size (Y), vscreen_max_size.y);
 
 				// Screens inside virtual screen
 				for (int sc = 0; sc < nb_screen; ++sc) {
-					positive_or_zero (v_screen_pos (sc, X)); offseted_less_than_var (v_screen_pos (sc, X), screen_sizes[sc].x, v_vscreen_size (X));
-					positive_or_zero (v_screen_pos (sc, Y)); offseted_less_than_var (v_screen_pos (sc, Y), screen_sizes[sc].y, v_vscreen_size (Y));
+					base_set.positive_or_zero (v_screen_pos (sc, X)); base_set.offseted_less_than_var (v_screen_pos (sc, X), screen_sizes[sc].x, v_vscreen_size (X));
+					base_set.positive_or_zero (v_screen_pos (sc, Y)); base_set.offseted_less_than_var (v_screen_pos (sc, Y), screen_sizes[sc].y, v_vscreen_size (Y));
 				}
+				base = base_set.release ();
+			}
+			~rectangle_packer_context (void) {
+				isl_set_free (base);
+				isl_local_space_free (ls);
+				isl_ctx_free (context);
+			}
+
+			// Template polyhedrons start from a copy of the base polyhedron
+			isl_local_space * local_space (void) const { return ls; }
+			isl_set * base_copy (void) const { return isl_set_copy (base); }
+
+			int nb_screen;
+			const pair_list & screen_sizes;
+
+			// Variable indexes
+			inline int v_objective (void) const { return 0; }
+			inline int v_vscreen_size (axis a) const { return v_objective () + 1 + a; }
+			inline int v_screen_pos (int sc, axis a) const { return v_vscreen_size (Next) + a * nb_screen + sc; } // All Y before all X
+			inline int v_max_var (int cnstr) const { return v_screen_pos (0, Next) + cnstr; }
+
+			inline int max_var_nb (void) const { return (nb_screen * (nb_screen - 1)) / 2; }
+			inline int v_nb (void) const { return v_max_var (max_var_nb ()); }
+
+		private:
+			isl_ctx * context;
+			isl_local_space * ls;
+			isl_set * base;
+
+			rectangle_packer_context (const rectangle_packer_context &);
+			rectangle_packer_context & operator= (const rectangle_packer_context &);
+	};
+
+	class rectangle_packer {
+		/* [ISL]
+		 * For each screen layout template, instantiate it by computing coordinates.
+		 * Metric is : sum of distance between centers of each related screen.
+		 *
+		 * Only ordering constraints and the objective are built here, on top of the context base polyhedron.
+		 */
+		public:
+			typedef rectangle_packer_context::axis axis;
+			static const axis X = rectangle_packer_context::X;
+			static const axis Y = rectangle_packer_context::Y;
+
+			rectangle_packer (const rectangle_packer_context & _context, const layout_template & layout) :
+				context (_context), nb_screen (_context.nb_screen), constraints (_context.local_space (), _context.base_copy ()), solution (0), next_max_var (0)
+			{
+				const pair_list & screen_sizes = context.screen_sizes;
 
 				// Screen ordering constraints
 				for (int sa = 0;  sa < nb_screen; ++sa)
 					for (int sb = 0; sb < sa; ++sb)
 						switch (layout.ordering (sa, sb)) {
-							case left: offseted_less_than_var (v_screen_pos (sa, X), screen_sizes[sa].x, v_screen_pos (sb, X)); break;
-							case right: offseted_less_than_var (v_screen_pos (sb, X), screen_sizes[sb].x, v_screen_pos (sa, X)); break;
-							case above: offseted_less_than_var (v_screen_pos (sa, Y), screen_sizes[sa].y, v_screen_pos (sb, Y)); break;
-							case under: offseted_less_than_var (v_screen_pos (sb, Y), screen_sizes[sb].y, v_screen_pos (sa, Y)); break;
+							case left: constraints.offseted_less_than_var (v_screen_pos (sa, X), screen_sizes[sa].x, v_screen_pos (sb, X)); break;
+							case right: constraints.offseted_less_than_var (v_screen_pos (sb, X), screen_sizes[sb].x, v_screen_pos (sa, X)); break;
+							case above: constraints.offseted_less_than_var (v_screen_pos (sa, Y), screen_sizes[sa].y, v_screen_pos (sb, Y)); break;
+							case under: constraints.offseted_less_than_var (v_screen_pos (sb, Y), screen_sizes[sb].y, v_screen_pos (sa, Y)); break;
 							default: throw std::runtime_error ("rectangle_packer: unordered screens despite sequence pair"); 
 						}
 
@@ -90,7 +578,7 @@ namespace screen_layout {
 				const int constraint_gap_coeff = 1;
 				const int center_distance_coeff = 1;
 				
-				std::vector< int > coeffs (v_nb (), 0); // More practical to gather coeffs
+				std::vector< int > coeffs (context.v_nb (), 0); // More practical to gather coeffs
 				coeffs[v_objective ()] = -1; // 0 = -o + sum(...)
 
 				for (int sa = 0;  sa < nb_screen; ++sa)
@@ -115,102 +603,39 @@ namespace screen_layout {
 							default:
 								break; // Error handled before
 						}
-				equality (coeffs);
+				constraints.equality (coeffs);
 			}
 
-			~rectangle_packer (void) { destroy_solver (); }
+			~rectangle_packer (void) { if (solution != 0) isl_point_free (solution); }
 
 			bool solve (void) {
-				if (solutions != 0) {
-					solution = isl_set_sample_point (isl_set_lexmin (solutions));
-					solutions = 0;
-				}
+				isl_set * solutions = constraints.release ();
+				if (solutions != 0) solution = isl_set_sample_point (isl_set_lexmin (solutions));
 				return not isl_point_is_void (solution);
 			}
 
 			long objective (void) const { return solution_val (v_objective ()); }
 			pair virtual_screen (void) const { return pair (solution_val (v_vscreen_size (X)), solution_val (v_vscreen_size (Y))); }
-			pair_list screen_positions (void) const {
-				pair_list positions (nb_screen);
+			void screen_positions (pair_list & positions) const {
+				positions.resize (nb_screen);
 				for (int sc = 0; sc < nb_screen; ++sc) {
 					positions[sc].x = solution_val (v_screen_pos (sc, X));
 					positions[sc].y = solution_val (v_screen_pos (sc, Y));
 				}
-				return positions;
 			}
 
 		private:
-			enum axis { X = 1, Y = 0, Next = 2 }; // Always place Y before X, so that height is minimized
-
 			// Var
+			const rectangle_packer_context & context;
 			int nb_screen;
-			isl_ctx * context;
-			isl_local_space * ls;
-			isl_set * solutions;
+			constraint_set constraints;
 			isl_point * solution;
 
 			// Variable indexes
-			inline int v_objective (void) const { return 0; }
-			inline int v_vscreen_size (axis a) const { return v_objective () + 1 + a; }
-			inline int v_screen_pos (int sc, axis a) const { return v_vscreen_size (Next) + a * nb_screen + sc; } // All Y before all X
-			inline int v_max_var (int cnstr) const { return v_screen_pos (0, Next) + cnstr; }
-
-			inline int max_var_nb (void) const { return (nb_screen * (nb_screen - 1)) / 2; }
-			inline int v_nb (void) const { return v_max_var (max_var_nb ()); }
-
-			// Init
-			void init_solver (void) {
-				context = isl_ctx_alloc ();
-				isl_space * vars = isl_space_set_alloc (context, 0, v_nb ());
-				ls = isl_local_space_from_space (isl_space_copy (vars));
-				solutions = isl_set_universe (vars);
-				solution = 0;
-				next_max_var = 0;
-			}
-			void destroy_solver (void) {
-				if (solution != 0) isl_point_free (solution);
-				if (solutions != 0) isl_set_free (solutions);
-				isl_local_space_free (ls);
-				isl_ctx_free (context);
-			}
-
-			// Polyhedral contraints
-			void positive_or_zero (int v) { // 0 <= v
-				more_than_const (v, 0);
-			}
-			void more_than_const (int v, int constant) { // constant <= v
-				isl_constraint * more = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
-				more = isl_constraint_set_coefficient_si (more, isl_dim_set, v, 1);
-				more = isl_constraint_set_constant_si (more, -constant);
-				solutions = isl_set_add_constraint (solutions, more); 
-			}
-			void less_than_const (int v, int constant) { // v <= constant
-				isl_constraint * less = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
-				less = isl_constraint_set_coefficient_si (less, isl_dim_set, v, -1);
-				less = isl_constraint_set_constant_si (less, constant);
-				solutions = isl_set_add_constraint (solutions, less); 
-			}
-			void offseted_less_than_var (int v, int offset, int v2) { // v + offset <= v2
-				isl_constraint * less = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
-				less = isl_constraint_set_coefficient_si (less, isl_dim_set, v, -1);
-				less = isl_constraint_set_constant_si (less, -offset);
-				less = isl_constraint_set_coefficient_si (less, isl_dim_set, v2, 1);
-				solutions = isl_set_add_constraint (solutions, less);
-			}
-			void offseted_diff_less_than_var (int va, int vb, int offset, int mv) { // va - vb + offset <= mv
-				isl_constraint * less = isl_constraint_alloc_inequality (isl_local_space_copy (ls));
-				less = isl_constraint_set_coefficient_si (less, isl_dim_set, va, -1);
-				less = isl_constraint_set_coefficient_si (less, isl_dim_set, vb, 1);
-				less = isl_constraint_set_constant_si (less, -offset);
-				less = isl_constraint_set_coefficient_si (less, isl_dim_set, mv, 1);
-				solutions = isl_set_add_constraint (solutions, less);
-			}
-			void equality (const std::vector< int > & coeffs) {
-				isl_constraint * equ = isl_constraint_alloc_equality (isl_local_space_copy (ls));
-				for (unsigned c = 0; c < coeffs.size (); ++c)
-					equ = isl_constraint_set_coefficient_si (equ, isl_dim_set, c, coeffs[c]);
-				solutions = isl_set_add_constraint (solutions, equ);
-			}
+			inline int v_objective (void) const { return context.v_objective (); }
+			inline int v_vscreen_size (axis a) const { return context.v_vscreen_size (a); }
+			inline int v_screen_pos (int sc, axis a) const { return context.v_screen_pos (sc, a); }
+			inline int v_max_var (int cnstr) const { return context.v_max_var (cnstr); }
 
 			/* Distance helper
 			 * - picks a free variable (mv)
@@ -222,8 +647,8 @@ namespace screen_layout {
 			int next_max_var;
 			int distance_var (int sa_var, int sa_size, int sb_var, int sb_size) {
 				int mv = v_max_var (next_max_var++);
-				offseted_diff_less_than_var (sa_var, sb_var, (sa_size - sb_size) / 2, mv); // a - b
-				offseted_diff_less_than_var (sb_var, sa_var, (sb_size - sa_size) / 2, mv); // b - a
+				constraints.offseted_diff_less_than_var (sa_var, sb_var, (sa_size - sb_size) / 2, mv); // a - b
+				constraints.offseted_diff_less_than_var (sb_var, sa_var, (sb_size - sa_size) / 2, mv); // b - a
 				return mv;
 			}
 
@@ -236,37 +661,1445 @@ namespace screen_layout {
 			}
 	};
 
-	bool compute_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, pair & vscreen_size, pair_list & screen_positions) {
-		int nb_screen = screen_sizes.size ();
-		const long init = std::numeric_limits< long >::max ();
-		long last_objective = init;
-
-		// Iterate over layout templates
-		sequence_pair seq_pair (nb_screen);
-		do {
-			// Compare layout template to user constraints
-			int ok = 1;
-			for (int sa = 0; ok && sa < nb_screen; ++sa)
-				for (int sb = 0; ok && sb < sa; ++sb)
-					ok = user_constraints[sa][sb] == none || user_constraints[sa][sb] == seq_pair.ordering (sa, sb);
-
-			if (ok) {
-				// Compute positions	
-				rectangle_packer packer (nb_screen, vscreen_min_size, vscreen_max_size, screen_sizes, seq_pair);
-				if (packer.solve ()) {
-					long objective = packer.objective ();
-					pair virtual_screen_size = packer.virtual_screen ();
-
-					// Record solution only if better objective (and smaller)
-					if (objective < last_objective || (objective == last_objective && virtual_screen_size < vscreen_size)) {
-						last_objective = objective;
-						vscreen_size = virtual_screen_size;
-						screen_positions = packer.screen_positions ();
-					}
-				}
-			}
-		} while (seq_pair.next ());
-		return last_objective != init;
+	class lexicographic_simplex {
+		/*
+		 * Dense simplex for small linear programs with a lexicographic objective :
+		 *   lexmin (c_0.x, c_1.x, ...) subject to A.x <= b, x >= 0
+		 * All objectives are kept as reduced cost rows, and compared lexicographically to select the entering column.
+		 * Bland's rule (smallest index) prevents cycling on the degenerate vertices these problems are full of.
+		 * A first phase on artificial variables finds the initial basis when some b is negative.
+		 * Callers that know a feasible vertex can give it with solve_from (), which skips that phase.
+		 */
+		public:
+			typedef std::vector< double > row;
+
+			lexicographic_simplex (int _nb_var, int nb_objective) : nb_var (_nb_var), costs (nb_objective, row (_nb_var, 0)) {}
+
+			void set_cost (int objective, int var, double c) { costs[objective][var] = c; }
+			void add_constraint (const row & coeffs, double bound) { constraints.push_back (coeffs); bounds.push_back (bound); } // coeffs.x <= bound
+
+			bool solve (void) {
+				int nb_row = constraints.size ();
+				int nb_artificial = 0;
+				for (int i = 0; i < nb_row; ++i)
+					if (bounds[i] < 0) ++nb_artificial;
+				nb_col = nb_var + nb_row + nb_artificial;
+				rhs = nb_col;
+
+				// Tableau : structural, slack, artificial columns, then rhs
+				tableau.assign (nb_row, row (nb_col + 1, 0));
+				basis.assign (nb_row, 0);
+				int artificial = nb_var + nb_row;
+				for (int i = 0; i < nb_row; ++i) {
+					double sign = bounds[i] < 0 ? -1 : 1;
+					for (int v = 0; v < nb_var; ++v)
+						tableau[i][v] = sign * constraints[i][v];
+					tableau[i][nb_var + i] = sign;
+					tableau[i][rhs] = sign * bounds[i];
+					if (bounds[i] < 0) {
+						tableau[i][artificial] = 1;
+						basis[i] = artificial++;
+					} else {
+						basis[i] = nb_var + i;
+					}
+				}
+
+				// Phase 1 : minimize sum of artificials
+				if (nb_artificial > 0) {
+					std::vector< row > phase_costs (1, row (nb_col, 0));
+					for (int c = nb_var + nb_row; c < nb_col; ++c)
+						phase_costs[0][c] = 1;
+					reduced_costs (phase_costs);
+					if (not iterate (nb_col)) return false;
+					if (reduced[0][rhs] < -epsilon) return false; // Infeasible
+
+					// Pivot remaining (zero valued) artificials out of the basis when possible
+					for (int i = 0; i < nb_row; ++i)
+						if (basis[i] >= nb_var + nb_row)
+							for (int c = 0; c < nb_var + nb_row; ++c)
+								if (std::abs (tableau[i][c]) > epsilon) { pivot (i, c); break; }
+				}
+
+				return optimize ();
+			}
+
+			/* Same result as solve (), starting from a feasible vertex instead of phase 1.
+			 * The vertex is given as (var, row) pairs : each var is basic, its row constraint is tight, other slacks stay basic.
+			 * Falls back to solve () if the pivots are singular or the vertex is not feasible.
+			 */
+			bool solve_from (const std::vector< std::pair< int, int > > & start) {
+				int nb_row = constraints.size ();
+				nb_col = nb_var + nb_row;
+				rhs = nb_col;
+
+				tableau.assign (nb_row, row (nb_col + 1, 0));
+				basis.assign (nb_row, 0);
+				for (int i = 0; i < nb_row; ++i) {
+					std::copy (constraints[i].begin (), constraints[i].end (), tableau[i].begin ());
+					tableau[i][nb_var + i] = 1;
+					tableau[i][rhs] = bounds[i];
+					basis[i] = nb_var + i;
+				}
+				reduced.clear ();
+
+				for (unsigned k = 0; k < start.size (); ++k) {
+					int var = start[k].first, r = start[k].second;
+					if (std::abs (tableau[r][var]) < epsilon) return solve ();
+					pivot (r, var);
+				}
+				for (int i = 0; i < nb_row; ++i)
+					if (tableau[i][rhs] < -epsilon) return solve ();
+				return optimize ();
+			}
+
+			double value (int var) const {
+				for (unsigned i = 0; i < basis.size (); ++i)
+					if (basis[i] == var) return tableau[i][rhs];
+				return 0;
+			}
+
+		private:
+			static constexpr double epsilon = 1e-9;
+
+			int nb_var;
+			std::vector< row > costs;
+			std::vector< row > constraints;
+			row bounds;
+
+			int nb_col, rhs;
+			std::vector< row > tableau;
+			std::vector< row > reduced; // Reduced costs, and -objective value in rhs column
+			std::vector< int > basis;
+
+			// Phase 2 : lexicographic objective, artificials may not enter
+			bool optimize (void) {
+				std::vector< row > phase_costs (costs.size (), row (nb_col, 0));
+				for (unsigned k = 0; k < costs.size (); ++k)
+					std::copy (costs[k].begin (), costs[k].end (), phase_costs[k].begin ());
+				reduced_costs (phase_costs);
+				return iterate (nb_var + int (constraints.size ()));
+			}
+
+			void reduced_costs (const std::vector< row > & phase_costs) {
+				reduced.assign (phase_costs.size (), row (nb_col + 1, 0));
+				for (unsigned k = 0; k < phase_costs.size (); ++k) {
+					std::copy (phase_costs[k].begin (), phase_costs[k].end (), reduced[k].begin ());
+					for (unsigned i = 0; i < basis.size (); ++i) {
+						double c = phase_costs[k][basis[i]];
+						if (c != 0)
+							for (int j = 0; j <= nb_col; ++j)
+								reduced[k][j] -= c * tableau[i][j];
+					}
+				}
+			}
+
+			bool lexicographic_negative (int c) const {
+				for (unsigned k = 0; k < reduced.size (); ++k) {
+					if (reduced[k][c] < -epsilon) return true;
+					if (reduced[k][c] > epsilon) return false;
+				}
+				return false;
+			}
+
+			// Columns [0, nb_allowed[ may enter the basis. Returns false if unbounded.
+			bool iterate (int nb_allowed) {
+				std::vector< bool > in_basis (nb_col, false);
+				for (unsigned i = 0; i < basis.size (); ++i)
+					in_basis[basis[i]] = true;
+
+				for (int iteration = 0; iteration < 100000; ++iteration) {
+					int enter = -1;
+					for (int c = 0; enter == -1 && c < nb_allowed; ++c)
+						if (not in_basis[c] && lexicographic_negative (c)) enter = c;
+					if (enter == -1) return true; // Optimal
+
+					int leave = -1;
+					double best_ratio = 0;
+					for (unsigned i = 0; i < basis.size (); ++i)
+						if (tableau[i][enter] > epsilon) {
+							double ratio = tableau[i][rhs] / tableau[i][enter];
+							if (leave == -1 || ratio < best_ratio - epsilon || (ratio < best_ratio + epsilon && basis[i] < basis[leave])) {
+								leave = i;
+								best_ratio = ratio;
+							}
+						}
+					if (leave == -1) return false;
+
+					in_basis[basis[leave]] = false;
+					in_basis[enter] = true;
+					pivot (leave, enter);
+				}
+				throw std::runtime_error ("lexicographic_simplex: no convergence");
+			}
+
+			void pivot (int r, int c) {
+				row & pivot_row = tableau[r];
+				double p = pivot_row[c];
+				for (int j = 0; j <= nb_col; ++j)
+					pivot_row[j] /= p;
+				pivot_row[c] = 1;
+				for (unsigned i = 0; i < tableau.size (); ++i)
+					if (int (i) != r) eliminate (tableau[i], pivot_row, c);
+				for (unsigned k = 0; k < reduced.size (); ++k)
+					eliminate (reduced[k], pivot_row, c);
+				basis[r] = c;
+			}
+			void eliminate (row & target, const row & pivot_row, int c) const {
+				double f = target[c];
+				if (f == 0) return;
+				for (int j = 0; j <= nb_col; ++j) {
+					target[j] -= f * pivot_row[j];
+					if (std::abs (target[j]) < epsilon) target[j] = 0;
+				}
+				target[c] = 0;
+			}
+	};
+
+	class graph_packer_context {
+		/*
+		 * Problem data shared by all templates for the constraint graph packer.
+		 *
+		 * Also memoizes axis solutions : an axis problem only depends on which pairs are ordered on this axis, and how.
+		 * Many templates differ only by the direction of pairs ordered on the other axis, and share the axis problem.
+		 * Axis problems are keyed by their signature : one base 4 digit per pair (0 = other axis, 1 = sa first, 2 = sb first).
+		 * One context per search worker, so no locking.
+		 */
+		public:
+			graph_packer_context (int _nb_screen, const pair & _vscreen_min_size, const pair & _vscreen_max_size, const pair_list & _screen_sizes) :
+				nb_screen (_nb_screen), vscreen_min_size (_vscreen_min_size), vscreen_max_size (_vscreen_max_size), screen_sizes (_screen_sizes) {}
+
+			int nb_screen;
+			const pair & vscreen_min_size;
+			const pair & vscreen_max_size;
+			const pair_list & screen_sizes;
+
+			struct axis_solution {
+				bool feasible;
+				long objective;
+				int vscreen_size;
+				std::vector< int > positions;
+			};
+			typedef std::unordered_map< layout_template::packed, axis_solution > axis_solution_map;
+			mutable axis_solution_map axis_solutions[2];
+	};
+
+	class graph_packer {
+		/*
+		 * Same problem as rectangle_packer, solved without ISL.
+		 *
+		 * Constraints are difference constraints on each axis separately (horizontal and vertical constraint graphs).
+		 * The objective is also a sum of per axis terms : gaps of pairs ordered on the axis, center distances of the others.
+		 * Thus the ISL lexmin order (objective, height, width, y positions, x positions) splits in one lexmin per axis :
+		 *   (axis objective, virtual screen size, positions)
+		 * Each one is a tiny tension problem on the axis constraint graph, solved by a lexicographic simplex.
+		 * Its optimal faces are defined by difference constraints with integer offsets, so the optimum is integral.
+		 *
+		 * The simplex starts from the leftmost packing (longest paths in the axis constraint graph), which is a vertex.
+		 * It also gives the smallest virtual screen size : axis problems that cannot fit are rejected without simplex.
+		 */
+		public:
+			graph_packer (const graph_packer_context & _context, const layout_template & _layout) : context (_context), layout (_layout), nb_screen (_context.nb_screen) {}
+
+			bool solve (void) {
+				positions.assign (nb_screen, pair ());
+				return solve_axis (Y) && solve_axis (X);
+			}
+
+			long objective (void) const { return objectives[X] + objectives[Y]; }
+			pair virtual_screen (void) const { return vscreen; }
+			void screen_positions (pair_list & out) const { out.assign (positions.begin (), positions.end ()); }
+
+		private:
+			enum axis { X = 0, Y = 1 };
+			typedef graph_packer_context::axis_solution axis_solution;
+
+			const graph_packer_context & context;
+			const layout_template & layout;
+			int nb_screen;
+
+			long objectives[2];
+			pair vscreen;
+			pair_list positions;
+
+			static int & coord (pair & p, axis a) { return a == X ? p.x : p.y; }
+			static int coord (const pair & p, axis a) { return a == X ? p.x : p.y; }
+
+			bool solve_axis (axis a) {
+				// Pairs ordered on this axis (before, after), and pairs ordered on the other one
+				std::vector< std::pair< int, int > > gaps, centers;
+				layout_template::packed signature = 0;
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb) {
+						int digit = 0;
+						switch (layout.ordering (sa, sb)) {
+							case left: if (a == X) digit = 1; break;
+							case right: if (a == X) digit = 2; break;
+							case above: if (a == Y) digit = 1; break;
+							case under: if (a == Y) digit = 2; break;
+							default: throw std::runtime_error ("graph_packer: unordered screens");
+						}
+						switch (digit) {
+							case 1: gaps.push_back (std::make_pair (sa, sb)); break;
+							case 2: gaps.push_back (std::make_pair (sb, sa)); break;
+							default: centers.push_back (std::make_pair (sa, sb)); break;
+						}
+						signature |= layout_template::packed (digit) << (2 * layout_template::pair_index (sa, sb));
+					}
+
+				// Reuse the solution of an already solved identical axis problem
+				graph_packer_context::axis_solution_map & solutions = context.axis_solutions[a];
+				graph_packer_context::axis_solution_map::iterator it = solutions.find (signature);
+				if (it == solutions.end ())
+					it = solutions.insert (std::make_pair (signature, solve_axis_problem (a, gaps, centers))).first;
+
+				const axis_solution & solution = it->second;
+				if (not solution.feasible) return false;
+				for (int sc = 0; sc < nb_screen; ++sc)
+					coord (positions[sc], a) = solution.positions[sc];
+				coord (vscreen, a) = solution.vscreen_size;
+				objectives[a] = solution.objective;
+				return true;
+			}
+
+			axis_solution solve_axis_problem (axis a, const std::vector< std::pair< int, int > > & gaps, const std::vector< std::pair< int, int > > & centers) const {
+				axis_solution solution;
+				solution.feasible = false;
+
+				// Variables : positions, virtual screen size, center distances
+				const pair_list & sizes = context.screen_sizes;
+				int v_size = nb_screen;
+				int v_dist = nb_screen + 1;
+				int nb_var = v_dist + centers.size ();
+
+				// Lexicographic objectives : axis objective, virtual screen size, then each position
+				lexicographic_simplex lp (nb_var, 2 + nb_screen);
+				std::vector< double > c (nb_var, 0);
+				for (unsigned g = 0; g < gaps.size (); ++g) {
+					c[gaps[g].first]--; c[gaps[g].second]++; // o += after - before
+				}
+				for (unsigned d = 0; d < centers.size (); ++d)
+					c[v_dist + d] = 1; // o += dist (centers)
+				for (int v = 0; v < nb_var; ++v)
+					lp.set_cost (0, v, c[v]);
+				lp.set_cost (1, v_size, 1);
+				for (int sc = 0; sc < nb_screen; ++sc)
+					lp.set_cost (2 + sc, sc, 1);
+
+				// Virtual screen boundaries
+				c.assign (nb_var, 0); c[v_size] = 1; lp.add_constraint (c, coord (context.vscreen_max_size, a));
+				c.assign (nb_var, 0); c[v_size] = -1; lp.add_constraint (c, -coord (context.vscreen_min_size, a));
+
+				// Screens inside virtual screen (positions are positive by definition)
+				for (int sc = 0; sc < nb_screen; ++sc) {
+					c.assign (nb_var, 0); c[sc] = 1; c[v_size] = -1; lp.add_constraint (c, -coord (sizes[sc], a));
+				}
+
+				// Ordering : before + size <= after
+				for (unsigned g = 0; g < gaps.size (); ++g) {
+					int before = gaps[g].first, after = gaps[g].second;
+					c.assign (nb_var, 0); c[before] = 1; c[after] = -1; lp.add_constraint (c, -coord (sizes[before], a));
+				}
+
+				// Center distances : mv >= sa - sb + offset and mv >= sb - sa - offset (same offsets as rectangle_packer)
+				for (unsigned d = 0; d < centers.size (); ++d) {
+					int sa = centers[d].first, sb = centers[d].second;
+					int offset = (coord (sizes[sa], a) - coord (sizes[sb], a)) / 2;
+					c.assign (nb_var, 0); c[sa] = 1; c[sb] = -1; c[v_dist + d] = -1; lp.add_constraint (c, -offset);
+					c.assign (nb_var, 0); c[sa] = -1; c[sb] = 1; c[v_dist + d] = -1; lp.add_constraint (c, offset);
+				}
+
+				// Leftmost packing : positions by longest path (pairs ordered on the axis form a DAG), and the basis it is a vertex of
+				std::vector< long > start (nb_screen, 0);
+				std::vector< int > tight_gap (nb_screen, -1);
+				for (bool changed = true; changed;) {
+					changed = false;
+					for (unsigned g = 0; g < gaps.size (); ++g) {
+						int before = gaps[g].first, after = gaps[g].second;
+						if (start[before] + coord (sizes[before], a) > start[after]) {
+							start[after] = start[before] + coord (sizes[before], a);
+							tight_gap[after] = g;
+							changed = true;
+						}
+					}
+				}
+				int row_gap = 2 + nb_screen;
+				int row_center = row_gap + gaps.size ();
+
+				long needed = 0;
+				int widest = 0;
+				for (int sc = 0; sc < nb_screen; ++sc)
+					if (start[sc] + coord (sizes[sc], a) > needed) {
+						needed = start[sc] + coord (sizes[sc], a);
+						widest = sc;
+					}
+				if (std::max< long > (needed, coord (context.vscreen_min_size, a)) > coord (context.vscreen_max_size, a))
+					return solution;
+
+				// Pivot order follows positions, so that each tight gap only involves already basic screens
+				std::vector< int > order (nb_screen);
+				for (int sc = 0; sc < nb_screen; ++sc) order[sc] = sc;
+				std::stable_sort (order.begin (), order.end (), [&start] (int sa, int sb) { return start[sa] < start[sb]; });
+				std::vector< std::pair< int, int > > basis;
+				for (int k = 0; k < nb_screen; ++k)
+					if (tight_gap[order[k]] >= 0) basis.push_back (std::make_pair (order[k], row_gap + tight_gap[order[k]]));
+				basis.push_back (std::make_pair (v_size, needed >= coord (context.vscreen_min_size, a) ? 2 + widest : 1));
+				for (unsigned d = 0; d < centers.size (); ++d) {
+					int sa = centers[d].first, sb = centers[d].second;
+					long diff = start[sa] - start[sb] + (coord (sizes[sa], a) - coord (sizes[sb], a)) / 2;
+					basis.push_back (std::make_pair (v_dist + d, row_center + 2 * d + (diff >= 0 ? 0 : 1)));
+				}
+
+				if (not lp.solve_from (basis)) return solution;
+
+				// Read integral solution, and compute objective exactly from it
+				solution.feasible = true;
+				solution.positions.resize (nb_screen);
+				for (int sc = 0; sc < nb_screen; ++sc)
+					solution.positions[sc] = std::lround (lp.value (sc));
+				solution.vscreen_size = std::lround (lp.value (v_size));
+
+				long o = 0;
+				for (unsigned g = 0; g < gaps.size (); ++g)
+					o += solution.positions[gaps[g].second] - solution.positions[gaps[g].first];
+				for (unsigned d = 0; d < centers.size (); ++d) {
+					int sa = centers[d].first, sb = centers[d].second;
+					long diff = solution.positions[sa] - solution.positions[sb] + (coord (sizes[sa], a) - coord (sizes[sb], a)) / 2;
+					o += std::abs (diff);
+				}
+				solution.objective = o;
+				return solution;
+			}
+	};
+
+	template< int N > static bool basic_objective_lower_bound (const layout_template & layout, const pair & vscreen_max_size, const pair_list & screen_sizes, long & lower_bound) {
+		/*
+		 * Cheap bound of the packer objective, without solving.
+		 *
+		 * The gap term of a left (resp. above) pair is at least the longest chain of widths (heights) between the two screens.
+		 * Chains are computed with a max-plus Floyd Warshall on each axis constraint graph.
+		 * Center distance terms can all be zero on their own, so they do not contribute.
+		 * The longest chain on each axis also gives the minimal virtual screen size : returns false if it cannot fit.
+		 * N > 0 is a compile time screen count (no heap allocation), as in basic_constrained_permutation.
+		 */
+		typedef screen_array< long, N > row;
+		typedef screen_array< typename row::type, N > matrix;
+		const int nb_screen = N > 0 ? N : screen_sizes.size ();
+		const long unrelated = -1;
+		typename matrix::type chain_x = matrix::make (nb_screen, row::make (nb_screen, unrelated));
+		typename matrix::type chain_y = matrix::make (nb_screen, row::make (nb_screen, unrelated));
+		for (int sa = 0; sa < nb_screen; ++sa)
+			for (int sb = 0; sb < sa; ++sb)
+				switch (layout.ordering (sa, sb)) {
+					case left: chain_x[sa][sb] = screen_sizes[sa].x; break;
+					case right: chain_x[sb][sa] = screen_sizes[sb].x; break;
+					case above: chain_y[sa][sb] = screen_sizes[sa].y; break;
+					case under: chain_y[sb][sa] = screen_sizes[sb].y; break;
+					default: break;
+				}
+		for (int k = 0; k < nb_screen; ++k)
+			for (int i = 0; i < nb_screen; ++i)
+				for (int j = 0; j < nb_screen; ++j) {
+					if (chain_x[i][k] != unrelated && chain_x[k][j] != unrelated) chain_x[i][j] = std::max (chain_x[i][j], chain_x[i][k] + chain_x[k][j]);
+					if (chain_y[i][k] != unrelated && chain_y[k][j] != unrelated) chain_y[i][j] = std::max (chain_y[i][j], chain_y[i][k] + chain_y[k][j]);
+				}
+
+		lower_bound = 0;
+		for (int j = 0; j < nb_screen; ++j) {
+			long start_x = 0, start_y = 0;
+			for (int i = 0; i < nb_screen; ++i) {
+				if (chain_x[i][j] != unrelated) { lower_bound += chain_x[i][j]; start_x = std::max (start_x, chain_x[i][j]); }
+				if (chain_y[i][j] != unrelated) { lower_bound += chain_y[i][j]; start_y = std::max (start_y, chain_y[i][j]); }
+			}
+			if (start_x + screen_sizes[j].x > vscreen_max_size.x || start_y + screen_sizes[j].y > vscreen_max_size.y) return false;
+		}
+		return true;
+	}
+
+	static inline bool objective_lower_bound (const layout_template & layout, const pair & vscreen_max_size, const pair_list & screen_sizes, long & lower_bound) {
+		return basic_objective_lower_bound< 0 > (layout, vscreen_max_size, screen_sizes, lower_bound);
+	}
+
+	struct layout_solution {
+		long objective;
+		pair vscreen_size;
+		pair_list screen_positions;
+		int template_index; // Rank of template in enumeration order
+
+		layout_solution (void) : objective (std::numeric_limits< long >::max ()), template_index (0) {}
+		bool found (void) const { return objective != std::numeric_limits< long >::max (); }
+
+		// Better objective, or same objective and smaller virtual screen, or same and earlier template
+		bool improved_by (long other_objective, const pair & other_vscreen_size, int other_index) const {
+			if (other_objective != objective) return other_objective < objective;
+			if (other_vscreen_size < vscreen_size) return true;
+			if (vscreen_size < other_vscreen_size) return false;
+			return other_index < template_index;
+		}
+		bool improved_by (const layout_solution & other) const { return improved_by (other.objective, other.vscreen_size, other.template_index); }
+
+		bool same_layout (const layout_solution & other) const {
+			if (vscreen_size.x != other.vscreen_size.x || vscreen_size.y != other.vscreen_size.y) return false;
+			for (unsigned sc = 0; sc < screen_positions.size (); ++sc)
+				if (screen_positions[sc].x != other.screen_positions[sc].x || screen_positions[sc].y != other.screen_positions[sc].y) return false;
+			return true;
+		}
+	};
+
+	class layout_ranking {
+		/*
+		 * The best distinct solutions found, best first, at most capacity of them.
+		 * Templates often lead to the same layout : duplicates are kept once, with the earliest template.
+		 * Solutions are moved in and out by swapping, so that position storage is recycled.
+		 */
+		public:
+			explicit layout_ranking (int _capacity = 1) : capacity (std::max (1, _capacity)) {}
+
+			int capacity_of (void) const { return capacity; }
+			bool empty (void) const { return solutions.empty (); }
+			std::vector< layout_solution > & list (void) { return solutions; }
+
+			// No solution with an objective above this one can enter the ranking
+			long bound (void) const { return full () ? solutions.back ().objective : std::numeric_limits< long >::max (); }
+
+			// Test before computing positions : a false result means that insert would reject the solution
+			bool accepts (long objective, const pair & vscreen_size, int index) const {
+				return not full () || solutions.back ().improved_by (objective, vscreen_size, index);
+			}
+
+			// Returns true if the candidate entered the ranking ; the candidate then holds a recycled solution
+			bool insert (layout_solution & candidate) {
+				unsigned i = 0;
+				while (i < solutions.size () && not solutions[i].same_layout (candidate)) ++i;
+				if (i < solutions.size ()) {
+					if (not solutions[i].improved_by (candidate)) return false;
+				} else if (full ()) {
+					if (not solutions.back ().improved_by (candidate)) return false;
+					i = solutions.size () - 1;
+				} else {
+					solutions.push_back (layout_solution ());
+				}
+				std::swap (solutions[i], candidate);
+				for (; i > 0 && solutions[i - 1].improved_by (solutions[i]); --i)
+					std::swap (solutions[i - 1], solutions[i]);
+				return true;
+			}
+
+			void merge (layout_ranking & other) {
+				for (unsigned i = 0; i < other.solutions.size (); ++i) insert (other.solutions[i]);
+			}
+
+		private:
+			int capacity;
+			std::vector< layout_solution > solutions;
+
+			bool full (void) const { return int (solutions.size ()) == capacity; }
+	};
+
+	typedef std::chrono::steady_clock search_clock;
+	static long nanoseconds_since (search_clock::time_point start) {
+		return std::chrono::duration_cast< std::chrono::nanoseconds > (search_clock::now () - start).count ();
+	}
+
+	class layout_search {
+		/*
+		 * Branch and bound over layout templates.
+		 *
+		 * Templates compatible with user constraints are enumerated first, with an objective lower bound.
+		 * They are then solved by increasing lower bound, so that good incumbents are found early.
+		 * Search stops when the next lower bound exceeds the best objective found.
+		 *
+		 * Workers pull templates from the sorted list, and share the objective bound of their ranking for pruning.
+		 * The shared bound is the smallest worker one : each worker alone has enough better solutions, so it is safe.
+		 * Each one keeps its local ranking ; ties are broken by enumeration rank, so merging them is deterministic.
+		 *
+		 * The deadline only stops enumeration once a template is kept, and solving once a layout is found :
+		 * even a tiny budget gives the best layout found so far, not none. Cancellation stops at once.
+		 */
+		public:
+			layout_search (const pair & _vscreen_min_size, const pair & _vscreen_max_size, const pair_list & _screen_sizes, const setting & user_constraints, int time_budget, enumeration_order order, const cancellation_token * _cancellation) :
+				nb_screen (_screen_sizes.size ()),
+				vscreen_min_size (_vscreen_min_size), vscreen_max_size (_vscreen_max_size), screen_sizes (_screen_sizes),
+				has_deadline (time_budget != 0), cancellation (_cancellation), interrupted (false), cancelled (false), enumeration_interrupted (false),
+				next_template (0), best_objective (std::numeric_limits< long >::max ()), solution_found (false)
+			{
+				if (nb_screen > layout_template::max_screen)
+					throw std::runtime_error ("compute_screen_layout: too many screens");
+
+				// Enumeration alone can exceed the budget for many screens : it stops at half budget (once a template is kept), keeping the prefix seen so far
+				start = clock::now ();
+				deadline = start + std::chrono::microseconds (500l * time_budget);
+
+				// Usual screen counts use precomputed templates
+				if (order == minimal_change_order) enumerate_minimal_change (user_constraints);
+				else switch (nb_screen) {
+					case 1: enumerate_table< 1 > (user_constraints); break;
+					case 2: enumerate_table< 2 > (user_constraints); break;
+					case 3: enumerate_table< 3 > (user_constraints); break;
+					case 4: enumerate_table< 4 > (user_constraints); break;
+					default: enumerate< 0 > (user_constraints); break;
+				}
+				std::stable_sort (templates.begin (), templates.end ());
+				deadline = start + std::chrono::milliseconds (time_budget);
+				enumeration_ns = nanoseconds_since (start);
+			}
+
+			int nb_template (void) const { return templates.size (); }
+
+			// Search wide stats ; worker ones are in the search_stats given to search ()
+			void fill_stats (search_stats & stats) const {
+				stats.complete = complete ();
+				stats.cancelled = cancelled;
+				stats.nb_template = nb_enumerated;
+				if (not enumeration_interrupted) {
+					long nb_sequence_pair = 1;
+					for (int i = 2; i <= nb_screen; ++i) nb_sequence_pair *= i;
+					stats.nb_template_constraint_rejected = nb_sequence_pair * nb_sequence_pair - nb_enumerated;
+				}
+				stats.nb_template_bound_rejected = nb_enumerated - templates.size ();
+				stats.nb_template_pruned = templates.size () - stats.nb_packer;
+				stats.enumeration_ns = enumeration_ns;
+				stats.total_ns = nanoseconds_since (start);
+			}
+
+			// False if the time budget (or cancellation) stopped the search before all templates were solved or pruned
+			bool complete (void) const { return not interrupted; }
+
+			// Solver context for a worker, reused for all templates it packs
+			template< typename PackerContext > PackerContext * make_packer_context (void) const {
+				return new PackerContext (nb_screen, vscreen_min_size, vscreen_max_size, screen_sizes);
+			}
+
+			// Worker loop
+			template< typename PackerContext, typename Packer > void search (const PackerContext & packer_context, layout_ranking & ranking, search_stats & stats) {
+				layout_solution candidate;
+				for (unsigned i = next_template++; i < templates.size (); i = next_template++) {
+					const search_template & t = templates[i];
+					if (t.lower_bound > best_objective) break; // Sorted, so no later template can do better
+					if (stop_requested (solution_found)) break;
+
+					// Compute positions
+					clock::time_point build_start = clock::now ();
+					Packer packer (packer_context, t.relations);
+					clock::time_point solve_start = clock::now ();
+					bool solved = packer.solve ();
+					stats.packer_build_ns += std::chrono::duration_cast< std::chrono::nanoseconds > (solve_start - build_start).count ();
+					stats.packer_solve_ns += nanoseconds_since (solve_start);
+					stats.nb_packer++;
+
+					if (not solved) {
+						stats.nb_infeasible++;
+					} else {
+						long objective = packer.objective ();
+						pair virtual_screen_size = packer.virtual_screen ();
+
+						// Record solution only if better objective (and smaller) than the worst ranked one
+						if (ranking.accepts (objective, virtual_screen_size, t.index)) {
+							candidate.objective = objective;
+							candidate.vscreen_size = virtual_screen_size;
+							packer.screen_positions (candidate.screen_positions); // Reuses evicted solution storage
+							candidate.template_index = t.index;
+							if (ranking.insert (candidate)) {
+								solution_found = true;
+								share_objective (ranking.bound ());
+								stats.nb_improving++;
+							}
+						}
+					}
+				}
+			}
+
+		private:
+			struct search_template {
+				layout_template relations;
+				long lower_bound;
+				int index;
+				bool operator< (const search_template & other) const { return lower_bound < other.lower_bound; }
+			};
+
+			typedef search_clock clock;
+
+			int nb_screen;
+			const pair & vscreen_min_size;
+			const pair & vscreen_max_size;
+			const pair_list & screen_sizes;
+
+			bool has_deadline;
+			clock::time_point deadline;
+			const cancellation_token * cancellation;
+			std::atomic< bool > interrupted;
+			std::atomic< bool > cancelled;
+			bool enumeration_interrupted;
+
+			clock::time_point start;
+			long enumeration_ns;
+			long nb_enumerated;
+			std::vector< search_template > templates;
+			std::atomic< unsigned > next_template;
+			std::atomic< long > best_objective;
+			std::atomic< bool > solution_found; // By any worker
+
+			bool deadline_passed (void) const { return has_deadline && clock::now () >= deadline; }
+
+			// Records the interruption if the search was cancelled, or if the deadline passed once some progress was made
+			bool stop_requested (bool progress) {
+				if (cancellation != nullptr && cancellation->cancelled ()) cancelled = true;
+				else if (not progress || not deadline_passed ()) return false;
+				interrupted = true;
+				return true;
+			}
+
+			template< int N > void enumerate (const setting & user_constraints) {
+				int index = 0;
+				basic_sequence_pair< N > seq_pair (nb_screen, user_constraints);
+				for (bool more = seq_pair.first (); more; more = seq_pair.next (), ++index) {
+					if (index % 1024 == 0 && stop_requested (not templates.empty ())) {
+						enumeration_interrupted = true;
+						break;
+					}
+					search_template t;
+					t.relations = seq_pair.relations ();
+					t.index = index;
+					if (basic_objective_lower_bound< N > (t.relations, vscreen_max_size, screen_sizes, t.lower_bound))
+						templates.push_back (t);
+				}
+				nb_enumerated = index;
+			}
+
+			// Same as enumerate, but only filters the precomputed templates
+			template< int N > void enumerate_table (const setting & user_constraints) {
+				layout_template::packed mask, value;
+				constraint_signature (N, user_constraints, mask, value);
+				int index = 0;
+				for (const layout_template & relations : template_table< N > ()) {
+					if (not relations.matches (mask, value)) continue;
+					search_template t;
+					t.relations = relations;
+					t.index = index++;
+					if (basic_objective_lower_bound< N > (t.relations, vscreen_max_size, screen_sizes, t.lower_bound))
+						templates.push_back (t);
+				}
+				nb_enumerated = index;
+			}
+
+			// Same as enumerate, but the template is updated with changed pairs only
+			void enumerate_minimal_change (const setting & user_constraints) {
+				int index = 0;
+				minimal_change_sequence_pair seq_pair (nb_screen, user_constraints);
+				search_template t;
+				for (bool more = seq_pair.first (); more; more = seq_pair.next (), ++index) {
+					if (index % 1024 == 0 && stop_requested (not templates.empty ())) {
+						enumeration_interrupted = true;
+						break;
+					}
+					if (index == 0) t.relations = seq_pair.relations ();
+					else seq_pair.update_relations (t.relations);
+					t.index = index;
+					if (objective_lower_bound (t.relations, vscreen_max_size, screen_sizes, t.lower_bound))
+						templates.push_back (t);
+				}
+				nb_enumerated = index;
+			}
+
+			void share_objective (long objective) {
+				long current = best_objective;
+				while (objective < current && not best_objective.compare_exchange_weak (current, objective));
+			}
+	};
+
+	template< typename PackerContext, typename Packer >
+	static void search_worker (layout_search & search, layout_ranking & ranking, search_stats & stats, std::exception_ptr & error) {
+		try {
+			std::unique_ptr< PackerContext > packer_context (search.make_packer_context< PackerContext > ());
+			search.search< PackerContext, Packer > (*packer_context, ranking, stats);
+		} catch (...) {
+			error = std::current_exception ();
+		}
+	}
+
+	class layout_annealing {
+		/*
+		 * Heuristic search, for screen counts where enumerating all templates is too slow.
+		 *
+		 * Simulated annealing over sequence pairs compatible with user constraints, starting from the first enumerated one.
+		 * Neighbours swap two screens in a, in b or in both, or move one screen to another position of a or b.
+		 * Candidates violating user constraints are discarded ; the others are bounded, then evaluated by the packer.
+		 * Until a feasible template is found, all moves are accepted (random walk), and the deadline is not checked.
+		 * The random generator is seeded from options, so results are deterministic (unless stopped by the time budget).
+		 */
+		public:
+			layout_annealing (const pair & _vscreen_min_size, const pair & _vscreen_max_size, const pair_list & _screen_sizes, const setting & user_constraints, const search_options & options) :
+				nb_screen (_screen_sizes.size ()),
+				vscreen_min_size (_vscreen_min_size), vscreen_max_size (_vscreen_max_size), screen_sizes (_screen_sizes),
+				nb_iteration (options.heuristic_iterations), random (options.seed),
+				start (search_clock::now ()), has_deadline (options.time_budget != 0), deadline (start + std::chrono::milliseconds (options.time_budget)),
+				cancellation (options.cancellation.get ()), interrupted (false), cancelled (false), compatible (false)
+			{
+				if (nb_screen > layout_template::max_screen)
+					throw std::runtime_error ("compute_screen_layout: too many screens");
+
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb) {
+						bool sa_first_in_a, sa_first_in_b;
+						if (sequence_requirement (user_constraints[sa][sb], sa_first_in_a, sa_first_in_b)) {
+							requirements_a.push_back (sa_first_in_a ? requirement (sa, sb) : requirement (sb, sa));
+							requirements_b.push_back (sa_first_in_b ? requirement (sa, sb) : requirement (sb, sa));
+						}
+					}
+
+				sequence_pair seq_pair (nb_screen, user_constraints);
+				compatible = seq_pair.first ();
+				for (int s = 0; compatible && s < nb_screen; ++s) {
+					position_a.push_back (seq_pair.position_a (s));
+					position_b.push_back (seq_pair.position_b (s));
+				}
+			}
+
+			bool complete (void) const { return not interrupted; }
+			bool was_cancelled (void) const { return cancelled; }
+
+			template< typename PackerContext, typename Packer > void search (layout_ranking & ranking, search_stats & stats) {
+				if (not compatible) return;
+				PackerContext packer_context (nb_screen, vscreen_min_size, vscreen_max_size, screen_sizes);
+
+				long current = evaluate< PackerContext, Packer > (packer_context, 0, std::numeric_limits< double >::infinity (), ranking, stats);
+				double temperature = 0;
+				double cooling = 1;
+				if (current != infeasible) start_cooling (current, 1, temperature, cooling);
+
+				std::uniform_real_distribution< double > unit (0, 1);
+				for (int iteration = 1; nb_screen > 1 && iteration <= nb_iteration; ++iteration) {
+					if (cancellation != nullptr && cancellation->cancelled ()) cancelled = true;
+					if (cancelled || (has_deadline && not ranking.empty () && search_clock::now () >= deadline)) {
+						interrupted = true;
+						break;
+					}
+
+					std::vector< int > previous_a = position_a;
+					std::vector< int > previous_b = position_b;
+					// Metropolis criterion u < exp ((current - candidate) / T), as a limit on the candidate objective
+					double acceptance_limit = std::numeric_limits< double >::infinity ();
+					double u = unit (random);
+					if (current != infeasible && u > 0) acceptance_limit = current - temperature * std::log (u);
+
+					bool accept = false;
+					if (not random_move ()) {
+						stats.nb_template_constraint_rejected++;
+					} else {
+						long candidate = evaluate< PackerContext, Packer > (packer_context, iteration, acceptance_limit, ranking, stats);
+						if (current == infeasible) {
+							accept = true;
+							if (candidate != infeasible) start_cooling (candidate, iteration, temperature, cooling);
+						} else if (candidate != infeasible) {
+							accept = candidate <= current || candidate < acceptance_limit;
+						}
+						if (accept) current = candidate;
+					}
+					if (not accept) {
+						position_a.swap (previous_a);
+						position_b.swap (previous_b);
+					}
+					temperature *= cooling;
+				}
+				stats.total_ns = nanoseconds_since (start);
+			}
+
+		private:
+			typedef std::pair< int, int > requirement; // (before, after)
+			static const long infeasible = std::numeric_limits< long >::max ();
+
+			int nb_screen;
+			const pair & vscreen_min_size;
+			const pair & vscreen_max_size;
+			const pair_list & screen_sizes;
+
+			int nb_iteration;
+			std::mt19937 random;
+			search_clock::time_point start;
+			bool has_deadline;
+			search_clock::time_point deadline;
+			const cancellation_token * cancellation;
+			bool interrupted;
+			bool cancelled;
+
+			std::vector< requirement > requirements_a, requirements_b;
+			bool compatible; // Some sequence pair satisfies user constraints
+			std::vector< int > position_a, position_b; // Current state, position of each screen in the sequences
+			layout_solution candidate;
+
+			// Geometric cooling from a fraction of the first objective found, down to one pixel at the last iteration
+			void start_cooling (long objective, int iteration, double & temperature, double & cooling) const {
+				const double initial_ratio = 0.05;
+				const double final_temperature = 1;
+				temperature = std::max (final_temperature, initial_ratio * objective);
+				int remaining = std::max (1, nb_iteration - iteration);
+				cooling = std::pow (final_temperature / temperature, 1.0 / remaining);
+			}
+
+			int random_screen (void) { return std::uniform_int_distribution< int > (0, nb_screen - 1) (random); }
+
+			// Returns false if the new state violates user constraints
+			bool random_move (void) {
+				int s = random_screen ();
+				int t = random_screen ();
+				while (t == s) t = random_screen ();
+				switch (std::uniform_int_distribution< int > (0, 4) (random)) {
+					case 0: std::swap (position_a[s], position_a[t]); break;
+					case 1: std::swap (position_b[s], position_b[t]); break;
+					case 2: std::swap (position_a[s], position_a[t]); std::swap (position_b[s], position_b[t]); break;
+					case 3: move_to (position_a, s, position_a[t]); break;
+					case 4: move_to (position_b, s, position_b[t]); break;
+				}
+				return satisfies (position_a, requirements_a) && satisfies (position_b, requirements_b);
+			}
+
+			// Move screen s to position p in the sequence, shifting screens in between
+			static void move_to (std::vector< int > & position, int s, int p) {
+				int from = position[s];
+				for (unsigned t = 0; t < position.size (); ++t) {
+					if (from < p && from < position[t] && position[t] <= p) position[t]--;
+					if (p < from && p <= position[t] && position[t] < from) position[t]++;
+				}
+				position[s] = p;
+			}
+
+			static bool satisfies (const std::vector< int > & position, const std::vector< requirement > & requirements) {
+				for (unsigned i = 0; i < requirements.size (); ++i)
+					if (position[requirements[i].first] > position[requirements[i].second]) return false;
+				return true;
+			}
+
+			/* Objective of the current state, and updates the ranking.
+			 * Returns infeasible if there is no packing, or if the lower bound reaches acceptance_limit (it would be rejected anyway).
+			 * As acceptance_limit is above the current objective, such a state cannot improve the best solution either.
+			 * Ranked alternatives are thus only taken among visited states.
+			 */
+			template< typename PackerContext, typename Packer > long evaluate (const PackerContext & packer_context, int iteration, double acceptance_limit, layout_ranking & ranking, search_stats & stats) {
+				layout_template relations;
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb)
+						relations.set_ordering (sa, sb, sequence_ordering (position_a[sb] - position_a[sa], position_b[sb] - position_b[sa]));
+				stats.nb_template++;
+
+				long lower_bound;
+				if (not objective_lower_bound (relations, vscreen_max_size, screen_sizes, lower_bound)) {
+					stats.nb_template_bound_rejected++;
+					return infeasible;
+				}
+				if (lower_bound >= acceptance_limit) {
+					stats.nb_template_pruned++;
+					return infeasible;
+				}
+
+				search_clock::time_point build_start = search_clock::now ();
+				Packer packer (packer_context, relations);
+				search_clock::time_point solve_start = search_clock::now ();
+				bool solved = packer.solve ();
+				stats.packer_build_ns += std::chrono::duration_cast< std::chrono::nanoseconds > (solve_start - build_start).count ();
+				stats.packer_solve_ns += nanoseconds_since (solve_start);
+				stats.nb_packer++;
+				if (not solved) {
+					stats.nb_infeasible++;
+					return infeasible;
+				}
+
+				long objective = packer.objective ();
+				pair virtual_screen_size = packer.virtual_screen ();
+				if (ranking.accepts (objective, virtual_screen_size, iteration)) {
+					candidate.objective = objective;
+					candidate.vscreen_size = virtual_screen_size;
+					packer.screen_positions (candidate.screen_positions);
+					candidate.template_index = iteration;
+					if (ranking.insert (candidate)) stats.nb_improving++;
+				}
+				return objective;
+			}
+	};
+
+	template< typename PackerContext, typename Packer >
+	static void annealing_worker (layout_annealing & annealing, layout_ranking & ranking, search_stats & stats) {
+		annealing.search< PackerContext, Packer > (ranking, stats);
+	}
+
+	static void heuristic_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, layout_ranking & ranking, const search_options & options, search_stats & stats) {
+		layout_annealing annealing (vscreen_min_size, vscreen_max_size, screen_sizes, user_constraints, options);
+		stats = search_stats ();
+		stats.heuristic = true;
+		switch (options.solver) {
+			case isl_lexmin: annealing_worker< rectangle_packer_context, rectangle_packer > (annealing, ranking, stats); break;
+			case constraint_graph: annealing_worker< graph_packer_context, graph_packer > (annealing, ranking, stats); break;
+			default: throw std::runtime_error ("compute_screen_layout: unknown solver");
+		}
+		stats.complete = annealing.complete ();
+		stats.cancelled = annealing.was_cancelled ();
+	}
+
+	// Exact search (or annealing for many screens), without decomposition
+	static void ranked_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, layout_ranking & ranking, const search_options & options, search_stats & stats) {
+		if (options.heuristic_min_screen > 0 && int (screen_sizes.size ()) >= options.heuristic_min_screen) {
+			heuristic_screen_layout (vscreen_min_size, vscreen_max_size, screen_sizes, user_constraints, ranking, options, stats);
+			return;
+		}
+
+		layout_search search (vscreen_min_size, vscreen_max_size, screen_sizes, user_constraints, options.time_budget, options.enumeration, options.cancellation.get ());
+
+		int nb_thread = options.nb_thread > 0 ? options.nb_thread : std::thread::hardware_concurrency ();
+		nb_thread = std::max (1, std::min (nb_thread, search.nb_template ()));
+
+		// Run the search on a worker pool (the calling thread is one of the workers)
+		std::vector< layout_ranking > worker_ranking (nb_thread, layout_ranking (ranking.capacity_of ()));
+		std::vector< search_stats > worker_stats (nb_thread);
+		std::vector< std::exception_ptr > errors (nb_thread);
+		void (*worker) (layout_search &, layout_ranking &, search_stats &, std::exception_ptr &) = 0;
+		switch (options.solver) {
+			case isl_lexmin: worker = search_worker< rectangle_packer_context, rectangle_packer >; break;
+			case constraint_graph: worker = search_worker< graph_packer_context, graph_packer >; break;
+			default: throw std::runtime_error ("compute_screen_layout: unknown solver");
+		}
+
+		std::vector< std::thread > workers;
+		for (int t = 1; t < nb_thread; ++t)
+			workers.push_back (std::thread (worker, std::ref (search), std::ref (worker_ranking[t]), std::ref (worker_stats[t]), std::ref (errors[t])));
+		worker (search, worker_ranking[0], worker_stats[0], errors[0]);
+		for (unsigned t = 0; t < workers.size (); ++t)
+			workers[t].join ();
+		for (int t = 0; t < nb_thread; ++t)
+			if (errors[t]) std::rethrow_exception (errors[t]);
+
+		stats = search_stats ();
+		for (int t = 0; t < nb_thread; ++t) {
+			ranking.merge (worker_ranking[t]);
+			stats.nb_packer += worker_stats[t].nb_packer;
+			stats.nb_infeasible += worker_stats[t].nb_infeasible;
+			stats.nb_improving += worker_stats[t].nb_improving;
+			stats.packer_build_ns += worker_stats[t].packer_build_ns;
+			stats.packer_solve_ns += worker_stats[t].packer_solve_ns;
+		}
+		search.fill_stats (stats);
+	}
+
+	// Connected components of the user constraint graph, as lists of screens (increasing order)
+	static std::vector< std::vector< int > > constraint_components (const setting & user_constraints) {
+		int nb_screen = user_constraints.size ();
+		std::vector< int > component (nb_screen, -1);
+		std::vector< std::vector< int > > components;
+		for (int root = 0; root < nb_screen; ++root) {
+			if (component[root] >= 0) continue;
+			int c = components.size ();
+			components.push_back (std::vector< int > (1, root));
+			component[root] = c;
+			for (unsigned k = 0; k < components[c].size (); ++k) {
+				int s = components[c][k];
+				for (int t = 0; t < nb_screen; ++t)
+					if (component[t] < 0 && (user_constraints[s][t] != none || user_constraints[t][s] != none)) {
+						component[t] = c;
+						components[c].push_back (t);
+					}
+			}
+			std::sort (components[c].begin (), components[c].end ());
+		}
+		return components;
+	}
+
+	static void add_stats (search_stats & total, const search_stats & part) {
+		total.complete = total.complete && part.complete;
+		total.heuristic = total.heuristic || part.heuristic;
+		total.cancelled = total.cancelled || part.cancelled;
+		total.nb_template += part.nb_template;
+		total.nb_template_constraint_rejected += part.nb_template_constraint_rejected;
+		total.nb_template_bound_rejected += part.nb_template_bound_rejected;
+		total.nb_template_pruned += part.nb_template_pruned;
+		total.nb_packer += part.nb_packer;
+		total.nb_infeasible += part.nb_infeasible;
+		total.nb_improving += part.nb_improving;
+		total.enumeration_ns += part.enumeration_ns;
+		total.packer_build_ns += part.packer_build_ns;
+		total.packer_solve_ns += part.packer_solve_ns;
+	}
+
+	static bool decomposed_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, const std::vector< std::vector< int > > & components, pair & vscreen_size, pair_list & screen_positions, const search_options & options, search_stats & stats) {
+		/*
+		 * Screens of different components are unrelated : each component is packed on its own, and then
+		 * component bounding boxes are placed by a top level search without constraints.
+		 * The cost is a sum of small factorials instead of the one of the total screen count, but cross component terms
+		 * of the objective only count at the top level, so the result may not be optimal.
+		 * The time budget is shared by the sub searches : once spent, they still give their first layout.
+		 * Returns false if a component or the component placement is infeasible, or if cancelled.
+		 */
+		search_clock::time_point start = search_clock::now ();
+		search_options sub_options = options;
+		sub_options.decompose = false;
+		stats = search_stats ();
+		stats.heuristic = true;
+
+		// Remaining budget for the next sub search ; once spent (negative), sub searches stop at their first layout
+		struct budget {
+			static int remaining (const search_options & options, search_clock::time_point start) {
+				if (options.time_budget <= 0) return options.time_budget;
+				long remaining_ms = options.time_budget - nanoseconds_since (start) / 1000000;
+				return remaining_ms > 0 ? remaining_ms : -1;
+			}
+		};
+
+		int nb_component = components.size ();
+		pair_list component_sizes (nb_component);
+		std::vector< pair_list > component_positions (nb_component);
+		for (int c = 0; c < nb_component; ++c) {
+			const std::vector< int > & screens = components[c];
+			int nb_sub = screens.size ();
+			pair_list sub_sizes;
+			setting sub_constraints = mk_setting (nb_sub);
+			for (int i = 0; i < nb_sub; ++i) {
+				sub_sizes.push_back (screen_sizes[screens[i]]);
+				for (int j = 0; j < nb_sub; ++j) sub_constraints[i][j] = user_constraints[screens[i]][screens[j]];
+			}
+
+			search_stats sub_stats;
+			sub_options.time_budget = budget::remaining (options, start);
+			bool found = compute_screen_layout (pair (0, 0), vscreen_max_size, sub_sizes, sub_constraints, component_sizes[c], component_positions[c], sub_options, sub_stats);
+			add_stats (stats, sub_stats);
+			if (not found) return false;
+		}
+
+		// Place components as unconstrained rectangles
+		search_stats top_stats;
+		pair_list top_positions;
+		sub_options.time_budget = budget::remaining (options, start);
+		bool found = compute_screen_layout (vscreen_min_size, vscreen_max_size, component_sizes, mk_setting (nb_component), vscreen_size, top_positions, sub_options, top_stats);
+		add_stats (stats, top_stats);
+		if (not found) return false;
+
+		screen_positions.assign (screen_sizes.size (), pair ());
+		for (int c = 0; c < nb_component; ++c)
+			for (unsigned i = 0; i < components[c].size (); ++i)
+				screen_positions[components[c][i]] = pair (top_positions[c].x + component_positions[c][i].x, top_positions[c].y + component_positions[c][i].y);
+		stats.total_ns = nanoseconds_since (start);
+		return true;
+	}
+
+	bool compute_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, pair & vscreen_size, pair_list & screen_positions, const search_options & options, search_stats & stats) {
+		// Decompose only if some component has several screens : singletons alone are the whole problem again
+		if (options.decompose) {
+			std::vector< std::vector< int > > components = constraint_components (user_constraints);
+			bool grouped = false;
+			for (unsigned c = 0; c < components.size (); ++c) grouped = grouped || components[c].size () > 1;
+			if (components.size () > 1 && grouped) {
+				if (decomposed_screen_layout (vscreen_min_size, vscreen_max_size, screen_sizes, user_constraints, components, vscreen_size, screen_positions, options, stats))
+					return true;
+				// Bounding boxes of components may not fit where a global layout does : search the whole problem
+				if (stats.cancelled) return false;
+			}
+		}
+
+		layout_ranking ranking (1);
+		ranked_screen_layout (vscreen_min_size, vscreen_max_size, screen_sizes, user_constraints, ranking, options, stats);
+		if (stats.cancelled || ranking.empty ()) return false;
+		layout_solution & best = ranking.list ().front ();
+		vscreen_size = best.vscreen_size;
+		screen_positions.swap (best.screen_positions);
+		return true;
+	}
+
+	bool compute_screen_layout_ranking (const layout_problem & problem, int nb_solution, std::vector< layout_result > & results, const search_options & options, search_stats & stats) {
+		layout_ranking ranking (nb_solution);
+		ranked_screen_layout (problem.vscreen_min_size, problem.vscreen_max_size, problem.screen_sizes, problem.user_constraints, ranking, options, stats);
+		if (stats.cancelled) ranking.list ().clear ();
+		std::vector< layout_solution > & solutions = ranking.list ();
+		results.assign (solutions.size (), layout_result ());
+		for (unsigned i = 0; i < solutions.size (); ++i) {
+			results[i].found = true;
+			results[i].complete = stats.complete;
+			results[i].heuristic = stats.heuristic;
+			results[i].vscreen_size = solutions[i].vscreen_size;
+			results[i].screen_positions.swap (solutions[i].screen_positions);
+		}
+		return not results.empty ();
+	}
+
+	static void batch_worker (const std::vector< layout_problem > & problems, std::vector< layout_result > & results, std::vector< std::exception_ptr > & errors, std::atomic< unsigned > & next_problem, const search_options & options) {
+		for (unsigned i = next_problem++; i < problems.size (); i = next_problem++) {
+			try {
+				compute_screen_layout (problems[i], results[i], options);
+			} catch (...) {
+				errors[i] = std::current_exception ();
+			}
+		}
+	}
+
+	void compute_screen_layouts (const std::vector< layout_problem > & problems, std::vector< layout_result > & results, const search_options & options) {
+		results.assign (problems.size (), layout_result ());
+		if (problems.size () == 1) {
+			// Parallel template search instead
+			compute_screen_layout (problems[0], results[0], options);
+			return;
+		}
+
+		int nb_thread = options.nb_thread > 0 ? options.nb_thread : std::thread::hardware_concurrency ();
+		nb_thread = std::max (1, std::min< int > (nb_thread, problems.size ()));
+
+		// Problems are parallelized, not their template searches
+		search_options problem_options = options;
+		problem_options.nb_thread = 1;
+
+		std::vector< std::exception_ptr > errors (problems.size ());
+		std::atomic< unsigned > next_problem (0);
+		std::vector< std::thread > workers;
+		for (int t = 1; t < nb_thread; ++t)
+			workers.push_back (std::thread (batch_worker, std::cref (problems), std::ref (results), std::ref (errors), std::ref (next_problem), std::cref (problem_options)));
+		batch_worker (problems, results, errors, next_problem, problem_options);
+		for (unsigned t = 0; t < workers.size (); ++t)
+			workers[t].join ();
+		for (unsigned i = 0; i < problems.size (); ++i)
+			if (errors[i]) std::rethrow_exception (errors[i]);
+	}
+
+	static bool topological_positions (const std::vector< std::vector< bool > > & before, std::vector< int > & position) {
+		// Lowest index first among available screens, so the result is deterministic ; returns false if cyclic
+		int nb_screen = before.size ();
+		std::vector< bool > placed (nb_screen, false);
+		position.assign (nb_screen, 0);
+		for (int rank = 0; rank < nb_screen; ++rank) {
+			int next = -1;
+			for (int s = 0; next < 0 && s < nb_screen; ++s) {
+				if (placed[s]) continue;
+				bool available = true;
+				for (int t = 0; available && t < nb_screen; ++t)
+					if (not placed[t] && t != s && before[t][s]) available = false;
+				if (available) next = s;
+			}
+			if (next < 0) return false;
+			placed[next] = true;
+			position[next] = rank;
+		}
+		return true;
 	}
 
+	static bool sequences_from_positions (const pair_list & sizes, const pair_list & positions, std::vector< int > & position_a, std::vector< int > & position_b) {
+		/*
+		 * Sequence pair of an existing layout (position of each screen in a and b).
+		 *
+		 * Each pair is related by its separation axis (horizontal first), or by center offset if screens overlap (changed sizes).
+		 * A screen precedes another in a if it is left or above, and in b if it is left or under : both orders are topologically sorted.
+		 * Returns false if relations are cyclic.
+		 */
+		int nb_screen = sizes.size ();
+		std::vector< std::vector< bool > > before_a (nb_screen, std::vector< bool > (nb_screen, false));
+		std::vector< std::vector< bool > > before_b (nb_screen, std::vector< bool > (nb_screen, false));
+		for (int i = 0; i < nb_screen; ++i)
+			for (int j = 0; j < nb_screen; ++j) {
+				if (i == j) continue;
+				const pair & pi = positions[i]; const pair & si = sizes[i];
+				const pair & pj = positions[j]; const pair & sj = sizes[j];
+				dir d;
+				if (pi.x + si.x <= pj.x) d = left;
+				else if (pj.x + sj.x <= pi.x) d = right;
+				else if (pi.y + si.y <= pj.y) d = above;
+				else if (pj.y + sj.y <= pi.y) d = under;
+				else {
+					// Doubled center offsets
+					long dx = 2l * (pj.x - pi.x) + sj.x - si.x;
+					long dy = 2l * (pj.y - pi.y) + sj.y - si.y;
+					if (std::labs (dx) >= std::labs (dy)) d = dx > 0 || (dx == 0 && i < j) ? left : right;
+					else d = dy > 0 ? above : under;
+				}
+				before_a[i][j] = d == left || d == above;
+				before_b[i][j] = d == left || d == under;
+			}
+		return topological_positions (before_a, position_a) && topological_positions (before_b, position_b);
+	}
+
+	template< typename PackerContext, typename Packer >
+	static void insertion_search (const layout_problem & problem, int new_screen, const std::vector< int > & old_a, const std::vector< int > & old_b, const cancellation_token * cancellation, layout_solution & best, search_stats & stats) {
+		/*
+		 * Searches the n^2 insertions of the new screen in the old sequences, other screens keeping their relative orders.
+		 * Candidates compatible with user constraints are packed by increasing lower bound, until it exceeds the best objective.
+		 */
+		struct candidate {
+			layout_template relations;
+			long lower_bound;
+			int index;
+			bool operator< (const candidate & other) const { return lower_bound < other.lower_bound; }
+		};
+		typedef std::pair< int, int > requirement; // (before, after)
+
+		int nb_screen = problem.screen_sizes.size ();
+		std::vector< requirement > requirements_a, requirements_b;
+		for (int sa = 0; sa < nb_screen; ++sa)
+			for (int sb = 0; sb < sa; ++sb) {
+				bool sa_first_in_a, sa_first_in_b;
+				if (sequence_requirement (problem.user_constraints[sa][sb], sa_first_in_a, sa_first_in_b)) {
+					requirements_a.push_back (sa_first_in_a ? requirement (sa, sb) : requirement (sb, sa));
+					requirements_b.push_back (sa_first_in_b ? requirement (sa, sb) : requirement (sb, sa));
+				}
+			}
+
+		search_clock::time_point start = search_clock::now ();
+		std::vector< candidate > candidates;
+		std::vector< int > position_a (nb_screen), position_b (nb_screen);
+		for (int insert_b = 0; insert_b < nb_screen; ++insert_b)
+			for (int insert_a = 0; insert_a < nb_screen; ++insert_a) {
+				// Old screen positions (without new_screen) are shifted from the insertion point
+				for (int s = 0, old = 0; s < nb_screen; ++s) {
+					if (s == new_screen) {
+						position_a[s] = insert_a;
+						position_b[s] = insert_b;
+					} else {
+						position_a[s] = old_a[old] < insert_a ? old_a[old] : old_a[old] + 1;
+						position_b[s] = old_b[old] < insert_b ? old_b[old] : old_b[old] + 1;
+						++old;
+					}
+				}
+				stats.nb_template++;
+
+				bool compatible = true;
+				for (unsigned r = 0; compatible && r < requirements_a.size (); ++r)
+					compatible = position_a[requirements_a[r].first] < position_a[requirements_a[r].second] &&
+						position_b[requirements_b[r].first] < position_b[requirements_b[r].second];
+				if (not compatible) {
+					stats.nb_template_constraint_rejected++;
+					continue;
+				}
+
+				candidate c;
+				for (int sa = 0; sa < nb_screen; ++sa)
+					for (int sb = 0; sb < sa; ++sb)
+						c.relations.set_ordering (sa, sb, sequence_ordering (position_a[sb] - position_a[sa], position_b[sb] - position_b[sa]));
+				c.index = insert_b * nb_screen + insert_a;
+				if (objective_lower_bound (c.relations, problem.vscreen_max_size, problem.screen_sizes, c.lower_bound))
+					candidates.push_back (c);
+				else
+					stats.nb_template_bound_rejected++;
+			}
+		std::stable_sort (candidates.begin (), candidates.end ());
+		stats.enumeration_ns = nanoseconds_since (start);
+
+		PackerContext packer_context (nb_screen, problem.vscreen_min_size, problem.vscreen_max_size, problem.screen_sizes);
+		for (unsigned i = 0; i < candidates.size (); ++i) {
+			const candidate & c = candidates[i];
+			if (c.lower_bound > best.objective) {
+				stats.nb_template_pruned += candidates.size () - i;
+				break;
+			}
+			if (cancellation != nullptr && cancellation->cancelled ()) {
+				stats.complete = false;
+				stats.cancelled = true;
+				stats.nb_template_pruned += candidates.size () - i;
+				break;
+			}
+			search_clock::time_point build_start = search_clock::now ();
+			Packer packer (packer_context, c.relations);
+			search_clock::time_point solve_start = search_clock::now ();
+			bool solved = packer.solve ();
+			stats.packer_build_ns += std::chrono::duration_cast< std::chrono::nanoseconds > (solve_start - build_start).count ();
+			stats.packer_solve_ns += nanoseconds_since (solve_start);
+			stats.nb_packer++;
+			if (not solved) {
+				stats.nb_infeasible++;
+				continue;
+			}
+			long objective = packer.objective ();
+			pair virtual_screen_size = packer.virtual_screen ();
+			if (best.improved_by (objective, virtual_screen_size, c.index)) {
+				best.objective = objective;
+				best.vscreen_size = virtual_screen_size;
+				packer.screen_positions (best.screen_positions);
+				best.template_index = c.index;
+				stats.nb_improving++;
+			}
+		}
+		stats.total_ns = nanoseconds_since (start);
+	}
+
+	bool compute_screen_layout_insertion (const layout_problem & problem, int new_screen, const pair_list & previous_positions, layout_result & result, const search_options & options, search_stats & stats) {
+		int nb_screen = problem.screen_sizes.size ();
+		if (nb_screen > layout_template::max_screen)
+			throw std::runtime_error ("compute_screen_layout: too many screens");
+		if (new_screen < 0 || new_screen >= nb_screen || int (previous_positions.size ()) != nb_screen - 1)
+			throw std::runtime_error ("compute_screen_layout_insertion: invalid new screen or previous positions");
+
+		// Sequence pair of the old layout, with current sizes
+		pair_list old_sizes;
+		for (int s = 0; s < nb_screen; ++s)
+			if (s != new_screen) old_sizes.push_back (problem.screen_sizes[s]);
+		std::vector< int > old_a, old_b;
+		if (sequences_from_positions (old_sizes, previous_positions, old_a, old_b)) {
+			layout_solution best;
+			stats = search_stats ();
+			stats.heuristic = true;
+			switch (options.solver) {
+				case isl_lexmin: insertion_search< rectangle_packer_context, rectangle_packer > (problem, new_screen, old_a, old_b, options.cancellation.get (), best, stats); break;
+				case constraint_graph: insertion_search< graph_packer_context, graph_packer > (problem, new_screen, old_a, old_b, options.cancellation.get (), best, stats); break;
+				default: throw std::runtime_error ("compute_screen_layout: unknown solver");
+			}
+			if (stats.cancelled) {
+				result.found = false;
+				result.complete = false;
+				return false;
+			}
+			if (best.found ()) {
+				result.found = true;
+				result.complete = true;
+				result.heuristic = true;
+				result.vscreen_size = best.vscreen_size;
+				result.screen_positions.swap (best.screen_positions);
+				return true;
+			}
+		}
+
+		// Old layout order incompatible with constraints or limits : full search
+		return compute_screen_layout (problem, result, options, stats);
+	}
+
+	struct border {
+		int coord; // On the axis
+		int low, high; // Range on the other axis
+		int screen;
+		bool leading; // Left or top border
+		bool operator< (const border & other) const { return coord < other.coord || (coord == other.coord && low < other.low); }
+	};
+
+	// Trailing borders of screens equal to leading borders of others, with overlapping ranges, on one axis
+	static void touching_borders (const pair_list & positions, const pair_list & sizes, bool horizontal, dir before, setting & relations) {
+		std::vector< border > borders;
+		for (unsigned sc = 0; sc < positions.size (); ++sc) {
+			int pos = horizontal ? positions[sc].x : positions[sc].y;
+			int size = horizontal ? sizes[sc].x : sizes[sc].y;
+			int low = horizontal ? positions[sc].y : positions[sc].x;
+			int high = low + (horizontal ? sizes[sc].y : sizes[sc].x);
+			border leading = { pos, low, high, int (sc), true };
+			border trailing = { pos + size, low, high, int (sc), false };
+			borders.push_back (leading);
+			borders.push_back (trailing);
+		}
+		std::sort (borders.begin (), borders.end ());
+
+		// Sweep each group of borders on the same line by range start, keeping ranges still open
+		std::vector< const border * > open;
+		for (unsigned i = 0; i < borders.size (); ++i) {
+			const border & b = borders[i];
+			if (i == 0 || borders[i - 1].coord != b.coord) open.clear ();
+			unsigned kept = 0;
+			for (unsigned k = 0; k < open.size (); ++k)
+				if (open[k]->high > b.low) open[kept++] = open[k];
+			open.resize (kept);
+			for (unsigned k = 0; k < open.size (); ++k) {
+				const border & other = *open[k];
+				if (other.leading == b.leading || other.screen == b.screen) continue;
+				const border & trailing = b.leading ? other : b;
+				const border & leading = b.leading ? b : other;
+				if (trailing.low < leading.high && trailing.high > leading.low) {
+					relations[trailing.screen][leading.screen] = before;
+					relations[leading.screen][trailing.screen] = dir_invert (before);
+				}
+			}
+			open.push_back (&b);
+		}
+	}
+
+	void screen_adjacency (const pair_list & positions, const pair_list & sizes, setting & relations) {
+		if (positions.size () != sizes.size ())
+			throw std::runtime_error ("screen_adjacency: positions and sizes differ in length");
+		relations = mk_setting (positions.size ());
+		touching_borders (positions, sizes, true, left, relations);
+		touching_borders (positions, sizes, false, above, relations);
+	}
 }
@@ -22,6 +22,9 @@
 #ifndef H_SCREEN_LAYOUT
 #define H_SCREEN_LAYOUT
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace screen_layout {
@@ -64,10 +67,184 @@ namespace screen_layout {
 		}
 	}
 
-	typedef std::vector< std::vector< dir > > setting;
-	static inline setting mk_setting (int nb_screen) { return setting (nb_screen, std::vector< dir > (nb_screen, none)); }
+	/* Relation matrix between screens : setting[sa][sb] is the direction of sa relative to sb (left : sa is left of sb).
+	 * It is antisymmetric : setting[sb][sa] is dir_invert (setting[sa][sb]).
+	 * Stored row major in one int8 buffer ; rows are accessed as pointers.
+	 */
+	class setting {
+		public:
+			typedef std::int8_t cell;
 
-	bool compute_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, pair & vscreen_size, pair_list & screen_positions);
+			setting (void) : nb_screen (0) {}
+			explicit setting (int _nb_screen) : nb_screen (_nb_screen), cells (_nb_screen * _nb_screen, none) {}
+
+			int size (void) const { return nb_screen; }
+			cell * operator[] (int sa) { return &cells[sa * nb_screen]; }
+			const cell * operator[] (int sa) const { return &cells[sa * nb_screen]; }
+
+			cell * data (void) { return cells.data (); }
+			const cell * data (void) const { return cells.data (); }
+
+		private:
+			int nb_screen;
+			std::vector< cell > cells;
+	};
+	static inline setting mk_setting (int nb_screen) { return setting (nb_screen); }
+
+	// Packer backends : ISL lexmin, or dedicated solver on the screen constraint graphs (same results)
+	enum solver_backend {
+		isl_lexmin = 0,
+		constraint_graph = 1
+	};
+
+	// Template enumeration order : lexicographic sequence pairs, or minimal change (one pair ordering per step, without constraints)
+	enum enumeration_order {
+		lexicographic_order = 0,
+		minimal_change_order = 1
+	};
+
+	class cancellation_token {
+		/*
+		 * Stops the searches using it : from another thread, or when a descriptor becomes readable (like an event queue).
+		 * Searches check it between templates ; a cancelled search returns no layout.
+		 * A token can follow a parent : it is also cancelled when the parent is.
+		 */
+		public:
+			cancellation_token (void) : requested (false), watched_fd (-1) {}
+			explicit cancellation_token (const std::shared_ptr< const cancellation_token > & _parent) :
+				requested (false), watched_fd (-1), parent (_parent) {}
+
+			void cancel (void) { requested = true; }
+			void reset (void) { requested = false; }
+
+			// Also cancelled while fd has data to read (-1 = none) ; data is not consumed
+			void watch (int fd) { watched_fd = fd; }
+			int watched (void) const { return watched_fd; }
+
+			bool cancelled (void) const;
+
+		private:
+			std::atomic< bool > requested;
+			std::atomic< int > watched_fd;
+			std::shared_ptr< const cancellation_token > parent;
+
+			cancellation_token (const cancellation_token &);
+			cancellation_token & operator= (const cancellation_token &);
+	};
+
+	struct search_options {
+		int nb_thread; // Worker threads for the template search (0 = one per hardware thread)
+		solver_backend solver;
+		int time_budget; // Search deadline in milliseconds, including enumeration (0 = no limit, negative = already passed), only honoured once a layout is found
+
+		// Simulated annealing instead of exact search, from this screen count (0 = never, the default : exact search handles up to 8 screens)
+		int heuristic_min_screen;
+		int heuristic_iterations;
+		unsigned seed;
+
+		// Pack groups of screens unrelated by user constraints separately, then place groups (off by default :
+		// objective terms between groups are ignored, so the layout may not be optimal)
+		bool decompose;
+
+		// Exact search : order also breaks ties between equal solutions, so results may differ
+		enumeration_order enumeration;
+
+		// Optional (null = never cancelled), shared by copies of the options
+		std::shared_ptr< cancellation_token > cancellation;
+
+		search_options (void) :
+			nb_thread (0), solver (constraint_graph), time_budget (0),
+			heuristic_min_screen (0), heuristic_iterations (20000), seed (1),
+			decompose (false), enumeration (lexicographic_order) {}
+	};
+
+	// Information about a finished search
+	struct search_stats {
+		bool complete; // False if stopped by the time budget : the layout is then the best found so far, not an optimum
+		bool cached; // Result taken from a layout_cache, without search (counters are zero)
+		bool heuristic; // Layout found by a partial search (annealing, insertion, decomposition) : it may not be optimal
+		bool cancelled; // Stopped by the cancellation token of options : no layout is returned
+
+		// Templates
+		long nb_template; // Enumerated (compatible with user constraints)
+		long nb_template_constraint_rejected; // Sequence pairs excluded by user constraints (zero if enumeration was interrupted)
+		long nb_template_bound_rejected; // Enumerated, but cannot fit in the virtual screen maximum size
+		long nb_template_pruned; // Not packed : lower bound above the best objective, or time budget reached
+
+		// Packing
+		long nb_packer; // Packers built (one per solved template)
+		long nb_infeasible; // Packings without solution
+		long nb_improving; // Solutions improving the best one of their worker
+
+		// Durations in nanoseconds ; packer phases are summed over worker threads
+		long enumeration_ns; // Template enumeration, bounds and sorting
+		long packer_build_ns; // Packer constraint construction
+		long packer_solve_ns; // Packer optimization (isl_set_lexmin or simplex)
+		long total_ns;
+
+		search_stats (void) :
+			complete (true), cached (false), heuristic (false), cancelled (false),
+			nb_template (0), nb_template_constraint_rejected (0), nb_template_bound_rejected (0), nb_template_pruned (0),
+			nb_packer (0), nb_infeasible (0), nb_improving (0),
+			enumeration_ns (0), packer_build_ns (0), packer_solve_ns (0), total_ns (0) {}
+	};
+
+	bool compute_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, pair & vscreen_size, pair_list & screen_positions, const search_options & options, search_stats & stats);
+
+	static inline bool compute_screen_layout (const pair & vscreen_min_size, const pair & vscreen_max_size, const pair_list & screen_sizes, const setting & user_constraints, pair & vscreen_size, pair_list & screen_positions, const search_options & options = search_options ()) {
+		search_stats stats;
+		return compute_screen_layout (vscreen_min_size, vscreen_max_size, screen_sizes, user_constraints, vscreen_size, screen_positions, options, stats);
+	}
+
+	// Problem and result of compute_screen_layout as values, for callers that store them
+	struct layout_problem {
+		pair vscreen_min_size;
+		pair vscreen_max_size;
+		pair_list screen_sizes;
+		setting user_constraints;
+	};
+
+	struct layout_result {
+		bool found;
+		bool complete; // See search_stats
+		bool heuristic; // See search_stats
+		pair vscreen_size;
+		pair_list screen_positions;
+
+		layout_result (void) : found (false), complete (true), heuristic (false) {}
+	};
+
+	static inline bool compute_screen_layout (const layout_problem & problem, layout_result & result, const search_options & options, search_stats & stats) {
+		result.found = compute_screen_layout (problem.vscreen_min_size, problem.vscreen_max_size, problem.screen_sizes, problem.user_constraints, result.vscreen_size, result.screen_positions, options, stats);
+		result.complete = stats.complete;
+		result.heuristic = stats.heuristic;
+		return result.found;
+	}
+
+	static inline bool compute_screen_layout (const layout_problem & problem, layout_result & result, const search_options & options = search_options ()) {
+		search_stats stats;
+		return compute_screen_layout (problem, result, options, stats);
+	}
+
+	/* Up to nb_solution best distinct layouts found by one search, best first (empty if there is no solution).
+	 * Groups of unrelated screens are not decomposed, as alternatives are for the whole layout.
+	 */
+	bool compute_screen_layout_ranking (const layout_problem & problem, int nb_solution, std::vector< layout_result > & results, const search_options & options, search_stats & stats);
+
+	// Solves independent problems, spread over worker threads. Throws the error of the first invalid problem.
+	void compute_screen_layouts (const std::vector< layout_problem > & problems, std::vector< layout_result > & results, const search_options & options = search_options ());
+
+	/* Layout after screen new_screen was added to a known layout ; previous_positions are those of the other screens, in order.
+	 * The sequence pair of the previous layout is kept, and only the n^2 insertions of the new screen are searched.
+	 * Falls back to compute_screen_layout if no insertion is compatible with user constraints and limits.
+	 */
+	bool compute_screen_layout_insertion (const layout_problem & problem, int new_screen, const pair_list & previous_positions, layout_result & result, const search_options & options, search_stats & stats);
+
+	/* Relations between screens whose borders touch in a placed layout, in user constraints encoding.
+	 * relations[sa][sb] = left if the right border of sa is on the left border of sb, and their vertical ranges overlap ; same for above.
+	 * Borders are sorted and swept along each axis : O(n log n) plus the number of touching pairs.
+	 */
+	void screen_adjacency (const pair_list & positions, const pair_list & sizes, setting & relations);
 }
 
 #endif
@@ -19,8 +19,64 @@
 # OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 # WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
-from setuptools import setup, Extension
+from setuptools import setup, Extension, Command
 import io
+import os
+
+# Native layout engine, shared by the extension and the benchmark
+engine_sources = ["ext/screen_layout.cpp"]
+engine_libraries = ["isl"]
+engine_compile_args = ["-std=c++11", "-pthread"]
+engine_link_args = ["-pthread"]
+
+class build_bench (Command):
+    """ Builds the native benchmark of compute_screen_layout, as build/bench (run it for JSON lines results) """
+    description = "build the native screen layout benchmark"
+    user_options = [("build-dir=", "b", "directory for the benchmark executable (default: build)")]
+
+    def initialize_options (self):
+        self.build_dir = None
+    def finalize_options (self):
+        if self.build_dir is None:
+            self.build_dir = "build"
+
+    def run (self):
+        from distutils.ccompiler import new_compiler
+        from distutils.sysconfig import customize_compiler
+        compiler = new_compiler ()
+        customize_compiler (compiler)
+        objects = compiler.compile (["ext/bench.cpp"] + engine_sources,
+                output_dir = os.path.join (self.build_dir, "bench_obj"),
+                extra_postargs = engine_compile_args + ["-O2"])
+        compiler.link_executable (objects, "bench", output_dir = self.build_dir,
+                libraries = engine_libraries, extra_postargs = engine_link_args, target_lang = "c++")
+
+class check_engine (Command):
+    """ Builds and runs the native self checks of the layout engine internals (ext/check.cpp) """
+    description = "build and run the native layout engine checks"
+    user_options = [("build-dir=", "b", "directory for the check executable (default: build)")]
+
+    def initialize_options (self):
+        self.build_dir = None
+    def finalize_options (self):
+        if self.build_dir is None:
+            self.build_dir = "build"
+
+    def run (self):
+        import subprocess
+        from distutils.ccompiler import new_compiler
+        from distutils.sysconfig import customize_compiler
+        from distutils.errors import DistutilsError
+        compiler = new_compiler ()
+        customize_compiler (compiler)
+        # ext/check.cpp includes the engine sources itself
+        objects = compiler.compile (["ext/check.cpp"],
+                output_dir = os.path.join (self.build_dir, "check_obj"),
+                extra_postargs = engine_compile_args + ["-O2"])
+        compiler.link_executable (objects, "check", output_dir = self.build_dir,
+                libraries = engine_libraries, extra_postargs = engine_link_args, target_lang = "c++")
+        if subprocess.call ([os.path.join (self.build_dir, "check")]) != 0:
+            raise DistutilsError ("layout engine checks failed")
 
 setup (
         # Base info
@@ -33,9 +89,12 @@ setup (
         packages = ["slam"],
         ext_modules = [
             Extension ("slam.ext",
-                libraries = ["isl", "boost_python3"],
-                sources = ["ext/boost_wrapper.cpp", "ext/screen_layout.cpp"])
+                libraries = engine_libraries + ["boost_python3", "xcb", "xcb-randr"],
+                extra_compile_args = engine_compile_args,
+                extra_link_args = engine_link_args,
+                sources = ["ext/boost_wrapper.cpp", "ext/layout_cache.cpp", "ext/layout_future.cpp", "ext/layout_store.cpp", "ext/randr_query.cpp"] + engine_sources)
             ],
+        cmdclass = {"build_bench": build_bench, "check_engine": check_engine},
 
         # Metadata
         description = "Screen layout manager",
@@ -55,6 +55,15 @@ def default_configuration (config_dict):
     # Database
     normalize_or_default_path ("db_file", default_working_dir.joinpath ("database"))
 
+    # Layout computation cache, next to the database by default
+    normalize_or_default_path ("cache_file", config_dict["db_file"].with_suffix (".cache"))
+
+    # Maximum duration of a layout computation, in milliseconds
+    config_dict.setdefault ("layout_time_budget", 200)
+
+    # Place one new output around the current ones instead of searching the whole layout (not optimal)
+    config_dict.setdefault ("layout_insertion", False)
+
     # Backend
     config_dict.setdefault ("backend_module", xcb_backend)
     config_dict.setdefault ("backend_args", {})
@@ -77,14 +86,15 @@ def start (**config):
 
     # Try loading database file.
     # On failure we will just have an empty database, and start from zero.
-    config_manager = layout.Manager (config["db_file"])
+    config_manager = layout.Manager (config["db_file"], config["cache_file"], layout_time_budget = config["layout_time_budget"],
+            layout_insertion = config["layout_insertion"])
 
     # Launch backend and event loop
     # db_file is written at each modification of database to avoid failures
     try:
         backend = config["backend_module"].Backend (**config["backend_args"])
         try:
-            config_manager.start (backend)
+            config_manager.start (backend, cancel_on_events = not config["oneshot"])
             if not config["oneshot"]:
                 util.Daemon.event_loop (backend)
         except Exception:
@@ -37,6 +37,7 @@ logger = util.setup_logger (__name__)
 
 class LayoutError (Exception): pass
 class LayoutFatalError (Exception): pass
+class LayoutCancelled (Exception): pass # Search stopped by options.cancellation ; not a LayoutError, defaults would be stale too
 
 class BackendError (Exception): pass
 class BackendFatalError (Exception): pass
@@ -247,10 +248,15 @@ class ConcreteLayout (util.AttributeEquality):
 
     # Import/export
 
-    def from_abstract (self, abstract):
+    def from_abstract (self, abstract, cache = None, options = None, stats = None, previous = None):
         """
         Builds a new backend layout object from an abstract layout and current additionnal info
-        Absolute layout positionning uses the c++ isl extension
+        Absolute layout positionning uses the c++ isl extension (results are reused from cache if given)
+        options is an optional ext.SearchOptions (thread count, time budget, cancellation)
+        stats is an optional ext.SearchStats, filled with search counters
+        Raises LayoutCancelled if the search was cancelled
+        previous is an optional ConcreteLayout : if it has all outputs except one new, only the new one placement is searched
+        (heuristic, see ext.screen_layout_insertion ; the result then depends on previous and is not cached)
 
         It assumes the ConcreteLayout base object has correct Edid (bijection name <-> edid)
         """
@@ -265,11 +271,26 @@ class ConcreteLayout (util.AttributeEquality):
         
         # Compute absolute layout
         edids = abstract.outputs.keys ()
-        constraints = [[abstract.outputs[ea].rel (eb) for eb in edids] for ea in edids]
-        sizes = [concrete.outputs[names[e]].size () for e in edids]
-        result = ext.screen_layout (self.virtual_screen_min, self.virtual_screen_max, sizes, constraints)
+        if options is None:
+            options = ext.SearchOptions ()
+        if stats is None:
+            stats = ext.SearchStats ()
+        previous_positions = {o.edid: o.position for o in previous.outputs.values () if o.enabled} if previous is not None else {}
+        new_screens = [i for i, e in enumerate (edids) if e not in previous_positions]
+        if len (new_screens) == 1 and len (edids) > 1 and len (previous_positions) == len (edids) - 1:
+            result = ext.screen_layout_insertion (*self.layout_problem (abstract),
+                    new_screen = new_screens[0], previous_positions = [previous_positions[e] for e in edids if e in previous_positions],
+                    options = options, stats = stats)
+        else:
+            result = ext.screen_layout (*self.layout_problem (abstract), options = options, cache = cache, stats = stats)
+        if result is None and stats.cancelled:
+            raise LayoutCancelled ("layout search cancelled")
         if result is None:
             raise LayoutError ("unable to compute concrete positions")
+        if not result[2]:
+            logger.warn ("layout search stopped by time budget ({} ms), using best layout found".format (options.time_budget))
+        if result[3]:
+            logger.info ("layout found by a heuristic search, it may not be optimal")
 
         # Fill result
         concrete.virtual_screen_size = Pair (result[0])
@@ -277,6 +298,22 @@ class ConcreteLayout (util.AttributeEquality):
             concrete.outputs[names[edid]].position = Pair (result[1][i])
         return concrete
 
+    def layout_problem (self, abstract):
+        """
+        Positionning problem of an abstract layout with current additionnal info, as ext.screen_layout arguments
+        Screens are in abstract.outputs iteration order
+        """
+        names = self.name_map ()
+        edids = abstract.outputs.keys ()
+        constraints = [[abstract.outputs[ea].rel (eb) for eb in edids] for ea in edids]
+        sizes = [abstract.outputs[e].transform.rectangle_size (self.outputs[names[e]].preferred_size) for e in edids]
+        return (self.virtual_screen_min, self.virtual_screen_max, sizes, constraints)
+
+    def without_output (self, name):
+        """ Same layout with one output unplugged """
+        return ConcreteLayout (vs_size = self.virtual_screen_size, vs_min = self.virtual_screen_min, vs_max = self.virtual_screen_max,
+                outputs = {n: o for n, o in self.outputs.items () if n != name})
+
     def to_abstract (self):
         """
         Build an AbstractLayout from a ConcreteLayout.
@@ -284,60 +321,114 @@ class ConcreteLayout (util.AttributeEquality):
         """
         if self.manual ():
             raise LayoutFatalError ("cannot abstract manual ConcreteLayout in manual")
-        outputs = self.outputs.values ()
-        abstract = AbstractLayout (outputs = {o.edid: AbstractLayout.Output (transform = o.transform) for o in outputs})
+        outputs = list (self.outputs.values ())
 
-        # Extract neighbouring relations for each pair of outputs
-        for oa, ob in itertools.permutations (outputs, 2):
-            oa_corner, ob_corner = oa.position + oa.size (), ob.position + ob.size ()
-            if oa_corner.x == ob.position.x and oa.position.y < ob_corner.y and oa_corner.y > ob.position.y:
-                abstract.set_relation (oa.edid, Dir.left, ob.edid)
-            if oa_corner.y == ob.position.y and oa.position.x < ob_corner.x and oa_corner.x > ob.position.x:
-                abstract.set_relation (oa.edid, Dir.above, ob.edid)
-        return abstract
+        # Neighbouring relations (touching borders) computed by the extension : row i of the matrix is the neighbours of output i
+        relations = ext.screen_adjacency ([o.position for o in outputs], [o.size () for o in outputs])
+        n = len (outputs)
+        def neighbours (i):
+            row = relations[i * n : (i + 1) * n]
+            return {outputs[j].edid: rel for j, rel in enumerate (row) if rel != Dir.none}
+        return AbstractLayout (outputs = {o.edid: AbstractLayout.Output (transform = o.transform, neighbours = neighbours (i)) for i, o in enumerate (outputs)})
 
 ### Database ###
 
+class MemoryStore (object):
+    """ ext.LayoutStore interface in memory, used by Database when its file cannot be created """
+    def __init__ (self):
+        self.layouts = {}
+        self.metadata = {}
+        self.journals = collections.defaultdict (list)
+
+    def __len__ (self): return len (self.layouts)
+    def keys (self): return list (self.layouts.keys ())
+
+    def get (self, edids): return self.layouts.get (frozenset (edids))
+    def put (self, edids, value): self.layouts[frozenset (edids)] = value
+
+    def get_metadata (self, name): return self.metadata.get (name)
+    def put_metadata (self, name, value): self.metadata[name] = value
+
+    def read_journal (self, name): return list (self.journals[name])
+    def append_journal (self, name, value, restart):
+        if restart:
+            self.journals[name] = []
+        self.journals[name].append (value)
+
 class Database (object):
-    version = 4
+    version = 7
+    counters_compaction_threshold = 64
     """
     Database of AbstractLayout
-    Can be stored/loaded from/to files
-    Format v4 is:
-        * int : version number
-        * list of abstractlayout object dumps : layouts
-        * relation_counters dict : (output_nameA, relation, output_nameB) for every pair of outputs
+    Stored in an ext.LayoutStore file : layouts are read and written one at a time, opening reads none of them.
+    Format v7 is a layout store with:
+        * one record per set of edids : pickled abstractlayout dump
+        * "version" metadata : version number
+        * "relation_counters" journal : pickled entries, for (output_nameA, relation, output_nameB) of every pair of outputs
+            ("snapshot", dict of counters) : restarts the journal at every counters_compaction_threshold entries
+            ("increment", list of counter keys) : one per successfully applied layout
+        * "transform_counters" journal : same, for (edid, transform dump) of stored layouts
+            ("snapshot", dict of counters)
+            ("update", list of (counter key, difference)) : one per successfully applied layout
+    Format v6 (no transform counters), v5 (counters as "relation_counters" metadata) and v4 (pickle file) databases are converted when loaded.
+    Unusable files (invalid, other version) are moved to ".invalid" and replaced by an empty database,
+    which is kept in memory if the file cannot be created.
     """
-    def __init__ (self, db_file):
-        # Database : frozenset(edids) -> AbstractLayout ()
-        self.layouts = {}
-        
+    def __init__ (self, db_file, cache_file = None):
         # Relation usage counters : (nameA, rel, nameB) -> int | with nameA < nameB
         self.relation_counters = collections.defaultdict (int)
+
+        # Transform counters : (edid, transform dump) -> number of stored layouts with this transform for edid
+        self.transform_counters = collections.defaultdict (int)
         
-        # Load from database file
+        # Database : frozenset(edids) -> AbstractLayout (), in store
         self.db_file = db_file
         self.load_database ()
 
+        # Cache of concrete layout computations : kept in cache_file if not None
+        self.cache_file = cache_file
+        self.layout_cache = self.load_layout_cache ()
+
     # database access and update
 
+    def find_layout (self, key):
+        data = self.store.get (key)
+        return AbstractLayout.load (pickle.loads (data)) if data is not None else None
+
     def get_layout (self, key):
-        try:
-            return self.layouts[key]
-        except KeyError:
-            raise LayoutError ("layout for [{}] not found in database".format (",".join (key))) from None
+        layout = self.find_layout (key)
+        if layout is None:
+            raise LayoutError ("layout for [{}] not found in database".format (",".join (key)))
+        return layout
 
     def successfully_applied (self, abstract, concrete):
-        # update database
-        self.layouts[abstract.key ()] = abstract
+        # update database, and transform counters with the replaced layout
+        updates = collections.defaultdict (int)
+        previous = self.find_layout (abstract.key ())
+        if previous is not None:
+            for key in Database.transform_counter_keys (previous):
+                updates[key] -= 1
+        for key in Database.transform_counter_keys (abstract):
+            updates[key] += 1
+        self.store.put (abstract.key (), pickle.dumps (abstract.dump ()))
+        updates = [(key, diff) for key, diff in updates.items () if diff != 0]
+        if len (updates) > 0:
+            self.update_counters (self.transform_counters, ("update", updates))
+            self.store_counters ("transform_counters", self.transform_counters, ("update", updates))
 
         # increment statistics counters
+        increments = []
         for na, nb in itertools.permutations (concrete.outputs, 2):
             # increment relation usage counter
             relation = abstract.outputs[concrete.edid (na)].rel (concrete.edid (nb))
-            self.relation_counters[(na, relation, nb)] += 1
+            increments.append ((na, relation, nb))
+        self.update_counters (self.relation_counters, ("increment", increments))
+        self.store_counters ("relation_counters", self.relation_counters, ("increment", increments))
+        logger.info ("stored database into '{}'".format (self.db_file))
 
-        self.store_database ()
+    @staticmethod
+    def transform_counter_keys (abstract):
+        return [(edid, output.transform.dump ()) for edid, output in abstract.outputs.items ()]
 
     # default
 
@@ -355,12 +446,13 @@ class Database (object):
                 abstract.set_relation (concrete.edid (na), most_used, concrete.edid (nb))
 
         # For each known Edid, set transformation as the most frequent in the database
+        transforms = [(rx, rot) for rx in (False, True) for rot in sorted (Transform.rotations)]
         for edid in abstract.outputs:
-            transform_frequency = collections.defaultdict (int)
-            for key in self.layouts:
-                if edid in key:
-                    transform_frequency[self.layouts[key].outputs[edid].transform] += 1
-            abstract.outputs[edid].transform = max (transform_frequency, default = Transform (), key = transform_frequency.get)
+            def count (t):
+                return self.transform_counters.get ((edid, t), 0)
+            most_used = max (transforms, key = count)
+            if count (most_used) > 0:
+                abstract.outputs[edid].transform = Transform.load (most_used)
 
         return abstract
 
@@ -368,59 +460,145 @@ class Database (object):
         """ Generates a default layout with no relations or transformation """
         return AbstractLayout (outputs = {edid: AbstractLayout.Output () for edid in edid_set})
     
-    # store / load buffer version
+    # store / load
 
-    def load (self, buf):
-        """ Read the database with layouts from buf (pickle format) """
-        # check version
-        version = pickle.load (buf)
-        if not isinstance (version, int):
-            raise ValueError ("incorrect database format : version = {}".format (version))
-        if version != Database.version:
+    def load_database (self):
+        if not self.db_file.exists ():
+            logger.warn ("database file '{}' not found".format (self.db_file))
+        try:
+            self.open_database ()
+        except Exception as e:
+            # Invalid file is kept aside, and replaced by an empty one
+            self.store = None
+            if self.db_file.exists ():
+                invalid_file = self.db_file.with_suffix (".invalid")
+                logger.error ("unable to load database file '{}', moved to '{}': {}".format (self.db_file, invalid_file, e))
+                try:
+                    self.db_file.rename (invalid_file)
+                except OSError as e:
+                    logger.error ("unable to move database file '{}': {}".format (self.db_file, e))
+            try:
+                self.open_database ()
+            except Exception as e:
+                logger.error ("unable to create database file '{}', database is kept in memory: {}".format (self.db_file, e))
+                self.store = MemoryStore ()
+                self.read_database ()
+
+    def open_database (self):
+        try:
+            self.store = ext.LayoutStore (str (self.db_file))
+        except RuntimeError:
+            # Not a layout store : older pickle database (or invalid file)
+            if not self.db_file.exists ():
+                raise
+            self.convert_pickle_database ()
+            logger.info ("converted database '{}' to format v{}".format (self.db_file, Database.version))
+            self.store = ext.LayoutStore (str (self.db_file))
+        self.read_database ()
+        logger.info ("loaded database from '{}' ({} layouts)".format (self.db_file, len (self.store)))
+
+    def read_database (self):
+        version = self.store.get_metadata ("version")
+        version = int (version) if version is not None else None
+        if version == 5:
+            counters = self.store.get_metadata ("relation_counters")
+            counters = pickle.loads (counters) if counters is not None else {}
+            self.store.append_journal ("relation_counters", pickle.dumps (("snapshot", counters)), True)
+            version = 6
+        if version == 6:
+            # Transform counters from the stored layouts, read once
+            layouts = [self.get_layout (key) for key in self.store.keys ()]
+            self.store.append_journal ("transform_counters", pickle.dumps (("snapshot", Database.count_transforms (layouts))), True)
+            version = None
+        if version is None:
+            self.store.put_metadata ("version", str (Database.version).encode ())
+        elif version != Database.version:
             raise ValueError ("incorrect database version : {} (expected {})".format (version, Database.version))
 
-        # get layout database
-        layout_dump_list = pickle.load (buf)
-        for layout_dump in layout_dump_list:
-            layout = AbstractLayout.load (layout_dump)
-            self.layouts[layout.key ()] = layout
+        # Replay counters journals
+        self.nb_counters_entries = {}
+        self.relation_counters = self.read_counters ("relation_counters")
+        self.transform_counters = self.read_counters ("transform_counters")
 
-        # get relation_counters
-        self.relation_counters = collections.defaultdict (int, pickle.load (buf))
-                
-    def store (self, buf):
-        """ Outputs manager database into buffer object (pickle format) """
-        # version
-        pickle.dump (int (Database.version), buf)
+    @staticmethod
+    def count_transforms (layouts):
+        counters = collections.defaultdict (int)
+        for layout in layouts:
+            for key in Database.transform_counter_keys (layout):
+                counters[key] += 1
+        return dict (counters)
 
-        # database
-        layout_dump_list = [abstract.dump () for abstract in self.layouts.values ()]
-        pickle.dump (layout_dump_list, buf)
+    @staticmethod
+    def update_counters (counters, entry):
+        kind, data = entry
+        if kind == "increment":
+            for key in data:
+                counters[key] += 1
+        else:
+            for key, diff in data:
+                counters[key] += diff
+                if counters[key] == 0:
+                    del counters[key]
+
+    def read_counters (self, journal):
+        counters = collections.defaultdict (int)
+        entries = self.store.read_journal (journal)
+        for entry in entries:
+            kind, data = pickle.loads (entry)
+            if kind == "snapshot":
+                counters = collections.defaultdict (int, data)
+            else:
+                Database.update_counters (counters, (kind, data))
+        self.nb_counters_entries[journal] = len (entries)
+        return counters
+
+    def store_counters (self, journal, counters, entry):
+        # Per event write is one small journal entry ; once the journal is long, a snapshot replaces it
+        if self.nb_counters_entries[journal] >= Database.counters_compaction_threshold:
+            self.store.append_journal (journal, pickle.dumps (("snapshot", dict (counters))), True)
+            self.nb_counters_entries[journal] = 1
+        else:
+            self.store.append_journal (journal, pickle.dumps (entry), False)
+            self.nb_counters_entries[journal] += 1
 
-        # relation_counters
-        pickle.dump (dict (self.relation_counters), buf)
+    def load_pickle (self, buf):
+        """ Read a v4 database from buf (pickle format) : returns (layouts, relation_counters) """
+        # check version
+        version = pickle.load (buf)
+        if not isinstance (version, int):
+            raise ValueError ("incorrect database format : version = {}".format (version))
+        if version != 4:
+            raise ValueError ("incorrect database version : {} (expected 4)".format (version))
 
-    # store / load file version
+        layouts = [AbstractLayout.load (layout_dump) for layout_dump in pickle.load (buf)]
+        return layouts, pickle.load (buf)
 
-    def load_database (self):
-        try:
-            with self.db_file.open ("rb") as db:
-                self.load (db)
-                logger.info ("loaded database from '{}'".format (self.db_file))
-        except FileNotFoundError:
-            logger.warn ("database file '{}' not found".format (self.db_file))
-        except Exception as e:
-            logger.error ("unable to load database file '{}': {}".format (self.db_file, e))
+    def convert_pickle_database (self):
+        with self.db_file.open ("rb") as db:
+            layouts, relation_counters = self.load_pickle (db)
 
-    def store_database (self):
-        # Write to a temporary file
+        # Fill a temporary store, then replace the pickle file
         temp_file = self.db_file.with_suffix (".temp")
-        with temp_file.open ("wb") as db:
-            self.store (db)
-
-        # On success copy it to new position
+        if temp_file.exists ():
+            temp_file.unlink ()
+        store = ext.LayoutStore (str (temp_file))
+        store.put_metadata ("version", str (Database.version).encode ())
+        for layout in layouts:
+            store.put (layout.key (), pickle.dumps (layout.dump ()))
+        store.append_journal ("relation_counters", pickle.dumps (("snapshot", dict (relation_counters))), True)
+        store.append_journal ("transform_counters", pickle.dumps (("snapshot", Database.count_transforms (layouts))), True)
+        del store
         temp_file.rename (self.db_file)
-        logger.info ("stored database into '{}'".format (self.db_file))
+
+    def load_layout_cache (self):
+        if self.cache_file is not None:
+            try:
+                cache = ext.LayoutCache (str (self.cache_file))
+                logger.info ("loaded layout cache from '{}' ({} entries)".format (self.cache_file, len (cache)))
+                return cache
+            except Exception as e:
+                logger.error ("unable to load layout cache file '{}': {}".format (self.cache_file, e))
+        return ext.LayoutCache ()
 
 
 ### Manager ###
@@ -431,13 +609,26 @@ class Manager (Database):
 
     Receive and handle events from the backend.
     """
-    def __init__ (self, *args, **kwd):
+    def __init__ (self, *args, layout_time_budget = None, layout_insertion = False, **kwd):
         super ().__init__ (*args, **kwd)
 
-    def start (self, backend):
+        # Generated layouts for one new output keep the other outputs in place (heuristic), instead of a full search
+        self.layout_insertion = layout_insertion
+
+        # Layout computation parameters : None = no time limit
+        self.layout_options = ext.SearchOptions ()
+        if layout_time_budget is not None:
+            self.layout_options.time_budget = layout_time_budget
+        self.layout_options.cancellation = ext.CancellationToken ()
+
+    def start (self, backend, cancel_on_events = True):
         # Init with default empty layout
         self.current_concrete_layout = ConcreteLayout ()
 
+        # New backend events make a running layout search stale : stop it, the backend will notify the latest state
+        if cancel_on_events and backend.fileno () is not None:
+            self.layout_options.cancellation.watch (backend.fileno ())
+
         # Attach to backend, will force an update of the current_concrete_layout
         self.backend = backend
         self.backend.attach (lambda concrete: self.backend_changed (concrete))
@@ -491,19 +682,50 @@ class Manager (Database):
     #   * invalid time > x state changed, abort modification. event_loop will reload state and see what to do then
     #   * crtc allocation error > crtc shortage. using default state will also fail, so abort modification
     #   * x request error > abort modification
+    # LayoutCancelled:
+    #   * new backend events during the layout search > abort modification, the backend notifies its new state again
     # (Layout|Backend)FatalError:
     #   * invalid program state, bail out, do not catch
     # <other, like xcb badmatch>:
     #   * Badmatch should be avoided by backend, so abort if one goes through
     
-    def helper_apply_abstract (self, abstract, new_concrete_layout):
+    def helper_apply_abstract (self, abstract, new_concrete_layout, incremental = False):
         # Compute ConcreteLayout and apply it to backend
-        concrete = new_concrete_layout.from_abstract (abstract)
+        # incremental : layout generated without history, place a new output around the current ones if enabled
+        stats = ext.SearchStats ()
+        previous = self.current_concrete_layout if incremental and self.layout_insertion else None
+        try:
+            concrete = new_concrete_layout.from_abstract (abstract, self.layout_cache, self.layout_options, stats, previous)
+        except LayoutCancelled:
+            logger.info ("layout search cancelled by new backend events, abort change")
+            self.backend.request_update ()
+            return
+        finally:
+            logger.info ("layout search: {}".format (stats))
         self.backend.apply_concrete_layout (concrete)
 
         # Update manager data on success
         self.current_concrete_layout = concrete
         self.successfully_applied (abstract, concrete)
+        self.precompute_likely_layouts (concrete)
+
+    def precompute_likely_layouts (self, concrete):
+        """
+        Queue background computations of layouts for the output sets likely to come next.
+        These are the current set minus one output (unplugged or disabled), with the layout that would be applied.
+        When they happen, applying them will only need a cache lookup.
+        """
+        if len (concrete.outputs) < 2:
+            return
+        try:
+            for name in concrete.outputs:
+                subset = concrete.without_output (name)
+                edid_set = subset.connected_edids ()
+                abstract = self.find_layout (edid_set) or self.generate_statistical_layout (subset, edid_set)
+                self.layout_cache.precompute (*subset.layout_problem (abstract), options = self.layout_options)
+        except Exception as e:
+            # Only speculative, never prevent the real change
+            logger.error ("unable to precompute likely layouts: {}".format (e))
 
     def action_apply_from_table (self, new_concrete_layout, edid_set):
         # Try to apply stored layout
@@ -522,7 +744,7 @@ class Manager (Database):
         # Build a default config with no relation
         logger.info ("apply statistical layout [{}]".format (",".join (new_concrete_layout.outputs)))
         try:
-            return self.helper_apply_abstract (self.generate_statistical_layout (new_concrete_layout, edid_set), new_concrete_layout)
+            return self.helper_apply_abstract (self.generate_statistical_layout (new_concrete_layout, edid_set), new_concrete_layout, incremental = True)
         except LayoutError as e:
             logger.info ("unable to apply statistical layout: {}".format (e))
         except BackendError as e:
@@ -535,7 +757,7 @@ class Manager (Database):
         # Build a default config with no relation
         logger.info ("apply default layout")
         try:
-            self.helper_apply_abstract (self.generate_default_layout (edid_set), new_concrete_layout)
+            self.helper_apply_abstract (self.generate_default_layout (edid_set), new_concrete_layout, incremental = True)
         except (LayoutError, BackendError) as e:
             # Provide detailed error if we failed with this default one, as it should only fail in the backend
             logger.exception ("unable to apply default layout, abort change: {}".format (e))
@@ -33,6 +33,7 @@ import xcffib, xcffib.xproto, xcffib.randr
 
 from . import util
 from . import layout
+from . import ext
 from .util import Pair
 from .layout import BackendError, BackendFatalError
 
@@ -56,6 +57,7 @@ class Backend (util.Daemon):
         """
         self.dpi = kwd.get ("dpi", 96)
         self.update_callback = (lambda _: 0)
+        self.update_requested = False
         self.init_randr_connection (**kwd)
 
     def cleanup (self):
@@ -67,8 +69,9 @@ class Backend (util.Daemon):
     def activate (self):
         """ Daemon callback """
         # Flush all events
-        if self.flush_notify ():
-            # If one of them was from Randr, update the state, and notify manager
+        if self.flush_notify () or self.update_requested:
+            # If one of them was from Randr (or manager asked for it), update the state, and notify manager
+            self.update_requested = False
             try:
                 self.reload_state ()
             except BackendError as e:
@@ -86,7 +89,7 @@ class Backend (util.Daemon):
         """ Returns internal state debug info as a string """
         acc = "Screen: {:s}\n".format (self.screen_size)
         acc += "Modes\n"
-        for mode in self.screen_res.modes:
+        for mode in self.modes.values ():
             acc += "\t{0}\t{1[0]:s}  {1[1]}Hz\n".format (mode.id, mode_info (mode))
         acc += "CRTCs\n"
         for c in self.screen_res.crtcs:
@@ -108,7 +111,7 @@ class Backend (util.Daemon):
                 acc += "\t|\tModes[pref]: {}\n".format (util.sequence_stringify (enumerate (info.modes),
                     highlight = (lambda t: t[0] < info.num_preferred), stringify = (lambda t: t[1])))
                 acc += "\t\\\tProperties:\n"
-                for name, prop in info.props.items ():
+                for name, prop in self.prop_manager.get_properties (o).items ():
                     acc += "\t\t\t{}: {}\n".format (name, prop)
             else:
                 acc += "\t{}\t{}\tDisconnected\n".format (o, info.name)
@@ -123,6 +126,13 @@ class Backend (util.Daemon):
         self.update_callback = callback
         callback (self.to_concrete_layout ()) # initial call to let the manager update itself
 
+    def request_update (self):
+        """
+        Manager aborted the handling of the current state (layout search cancelled by pending events).
+        Notify it again at next activation, even if pending events are not from Randr.
+        """
+        self.update_requested = True
+
     def apply_concrete_layout (self, concrete):
         """ Set up a concretelayout from the manager in X """
         # Apply may generate new notifications from X, so reactivate us to handle them
@@ -152,6 +162,9 @@ class Backend (util.Daemon):
         # Internal state 
         screen_setup = self.conn.setup.roots[kwd.get ("screen", self.conn.pref_screen)]
         self.root = screen_setup.root
+
+        # Native state query, batching all requests of a reload in one round trip (uses its own connection)
+        self.randr_query = ext.RandrQuery (kwd.get ("display") or "", self.root)
         
         limits = self.conn.randr.GetScreenSizeRange (self.root).reply ()
         self.screen_limit_min = Pair.from_size (limits, "min_{}")
@@ -166,33 +179,27 @@ class Backend (util.Daemon):
         self.conn.flush ()
 
     def reload_state (self):
-        """ Updates the state by reloading everything """
-        # Get screen ressources and screen size (using geometry of root window)
-        cookie_res = self.conn.randr.GetScreenResources (self.root)
-        cookie_size = self.conn.core.GetGeometry (self.root)
-        self.screen_res = cookie_res.reply ()
-        self.screen_size = Pair.from_size (cookie_size.reply ())
-        
-        # Send queries for Crtc and Output info
-        crtc_req, output_req = {}, {}
-        for c in self.screen_res.crtcs:
-            crtc_req[c] = self.conn.randr.GetCrtcInfo (c, self.screen_res.config_timestamp)
-        for o in self.screen_res.outputs:
-            output_req[o] = self.conn.randr.GetOutputInfo (o, self.screen_res.config_timestamp)
+        """ Updates the state by reloading everything (screen ressources, size, crtcs, outputs and edids) """
+        state = self.randr_query.query ()
+        if state is None: raise BackendError ("invalid config timestamp (RandrQuery)")
+        self.screen_res = state
+        self.screen_size = Pair.from_size (state)
+
+        # Get modes by id (state.modes builds a new list at each access)
+        self.modes = {m.id: m for m in state.modes}
         
         # Get Crtc info
         self.crtcs = {}
-        for c in self.screen_res.crtcs:
-            self.crtcs[c] = check_reply (crtc_req[c].reply ())
-            self.crtcs[c].transform = XcbTransform.from_xcffib_struct (self.crtcs[c])
+        for c in state.crtc_info:
+            c.transform = XcbTransform.from_xcffib_struct (c)
+            self.crtcs[c.id] = c
 
-        # Get output info
+        # Get output info (only the edid property is needed for layouts, others are queried on dump)
         self.outputs = {}
-        for o in self.screen_res.outputs:
-            self.outputs[o] = check_reply (output_req[o].reply ())
-            self.outputs[o].name = bytes (self.outputs[o].name).decode ()
-            if self.is_connected (o):
-                self.outputs[o].props = self.prop_manager.get_properties (o)
+        for o in state.output_info:
+            self.outputs[o.id] = o
+            if self.is_connected (o.id):
+                o.props = {"edid": edid_identifier (o.edid)}
 
     def flush_notify (self):
         """ Discards all events, returns True if one was from Randr """
@@ -375,13 +382,13 @@ class Backend (util.Daemon):
     
     def mode_by_id (self, m_id):
         try:
-            return mode_info ([m for m in self.screen_res.modes if m.id == m_id][0])
-        except IndexError:
+            return mode_info (self.modes[m_id])
+        except KeyError:
             # Mode not found indicates some corruption in X data, bail out
             raise BackendFatalError ("mode {} not found".format (m_id))
     
     def mode_exists (self, m_id):
-        return len ([m for m in self.screen_res.modes if m.id == m_id]) == 1
+        return m_id in self.modes
     
     def preferred_mode_ids (self, o_data):
         if o_data.num_preferred > 0:
@@ -416,6 +423,16 @@ def check_reply (reply):
     # Other errors may indicate a bigger problem
     else: raise BackendError ("request failed ({})".format (req_name))
 
+def edid_identifier (edid):
+    """ Identifier string from raw EDID bytes : bytes 8-15 are enough for identification, the rest is mode data """
+    if len (edid) == 0:
+        logger.info ("invalid or missing 'edid' property")
+        return None
+    if edid[:8] != bytes ([0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00]):
+        logger.info ("'edid' lacks 1.3 constant header")
+        return None
+    return ''.join (map ("{:02X}".format, edid[8:16]))
+
 class XcbTransform (object):
     """
     Stores X rotation & rotation capability masks.
@@ -520,11 +537,10 @@ class PropertyQuery:
             try:
                 data = self.x.get_property (output, self.name)
                 if not (data.format == 8 and data.type == xcffib.xproto.Atom.INTEGER and data.bytes_after == 0 and data.num_items > 0): raise Fail ("invalid 'edid' value formatting")
-                if data.data[:8] != [0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00]: raise Fail ("'edid' lacks 1.3 constant header")
-                return ''.join (map ("{:02X}".format, data.data[8:16]))
             except Fail as e:
                 logger.info (e)
                 return None
+            return edid_identifier (bytes (data.data))
 
     class Backlight (Base):
         """